@@ -0,0 +1,196 @@
+// Headless agent: runs the same collectors as the GUI on the sampler thread
+// and writes every refreshed snapshot as NDJSON or binary records to stdout
+// or a file. Links no SDL or OpenGL, so it runs on servers without a display.
+#include "collector.h"
+#include <csignal> // For signal
+
+static atomic<bool> agent_running(true);
+static atomic<bool> host_info_stale(false);
+
+static void handleStopSignal(int)
+{
+    agent_running = false;
+}
+
+// SIGHUP: gather the cached host facts (OS, CPU type, user) again
+static void handleReloadSignal(int)
+{
+    host_info_stale = true;
+}
+
+static void printUsage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -i, --interval SECONDS   time between snapshots (default 1)\n"
+            "  -f, --format json|binary|none\n"
+            "                           output format (default json; none writes no stream)\n"
+            "  -o, --output FILE        write to FILE instead of stdout\n"
+            "  -n, --count N            stop after N snapshots (default: run until signalled)\n"
+            "  -s, --swap               also read /proc/[pid]/status for per-process swap\n"
+            "  -r, --record FILE        also append every snapshot to the recording FILE (+ FILE.idx)\n"
+            "  -m, --metrics-port PORT  serve OpenMetrics on http://127.0.0.1:PORT/metrics\n"
+            "      --shm [NAME]         publish every snapshot in POSIX shared memory NAME\n"
+            "                           (default " MONITOR_SHM_NAME "; layout in monitor_shm.h)\n"
+            "SIGHUP makes the agent read the host facts (OS, CPU type, user) again.\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    double interval = 1.0;
+    SnapshotFormat format = SNAPSHOT_JSON;
+    const char *outputPath = nullptr;
+    long long count = -1;
+    unsigned sources = PROC_SOURCE_STAT;
+    const char *recordPath = nullptr;
+    int metricsPort = 0;
+    const char *shmName = nullptr;
+    bool stream = true;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if ((arg == "-i" || arg == "--interval") && hasValue)
+            interval = atof(argv[++i]);
+        else if ((arg == "-f" || arg == "--format") && hasValue)
+        {
+            string name = argv[++i];
+            if (name == "json")
+                format = SNAPSHOT_JSON;
+            else if (name == "binary")
+                format = SNAPSHOT_BINARY;
+            else if (name == "none")
+                stream = false;
+            else
+            {
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+        else if ((arg == "-o" || arg == "--output") && hasValue)
+            outputPath = argv[++i];
+        else if ((arg == "-n" || arg == "--count") && hasValue)
+            count = atoll(argv[++i]);
+        else if (arg == "-s" || arg == "--swap")
+            sources |= PROC_SOURCE_STATUS;
+        else if ((arg == "-r" || arg == "--record") && hasValue)
+            recordPath = argv[++i];
+        else if ((arg == "-m" || arg == "--metrics-port") && hasValue)
+            metricsPort = atoi(argv[++i]);
+        else if (arg == "--shm")
+            shmName = hasValue && argv[i + 1][0] == '/' ? argv[++i] : MONITOR_SHM_NAME;
+        else
+        {
+            printUsage(argv[0]);
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        }
+    }
+    if (!(interval > 0.0) || metricsPort < 0 || metricsPort > 65535)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    FILE *output = !stream ? nullptr : outputPath ? fopen(outputPath, format == SNAPSHOT_BINARY ? "ab" : "a") : stdout;
+    if (stream && !output)
+    {
+        perror(outputPath);
+        return 1;
+    }
+
+    signal(SIGINT, handleStopSignal);
+    signal(SIGTERM, handleStopSignal);
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGHUP, handleReloadSignal);
+
+    // No plots: keep a single history sample per series, and run every
+    // collector no more often than the output needs it
+    Sampler sampler(1);
+    sampler.setPaused(true);
+    sampler.setHistoryRate((float)(1.0 / interval));
+    sampler.setScanInterval(interval);
+    sampler.setProcessSources(sources);
+    if (recordPath)
+    {
+        auto recorder = make_shared<SnapshotRecorder>();
+        string error;
+        if (!recorder->open(recordPath, error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        sampler.setRecorder(recorder);
+    }
+    if (shmName)
+    {
+        auto writer = make_shared<SharedSnapshotWriter>();
+        if (!writer->open(shmName))
+        {
+            perror(shmName);
+            return 1;
+        }
+        sampler.setSharedSnapshot(writer);
+    }
+    sampler.start();
+
+    OpenMetricsExporter exporter;
+    if (metricsPort && !exporter.start(metricsPort, [&sampler]() { return sampler.latest(); }))
+    {
+        fprintf(stderr, "can't listen on 127.0.0.1:%d\n", metricsPort);
+        sampler.stop();
+        return 1;
+    }
+
+    string buffer;
+    bool headerWritten = false;
+    unsigned long long lastSequence = 0;
+    chrono::steady_clock::time_point next = chrono::steady_clock::now();
+
+    while (agent_running && count != 0)
+    {
+        next += chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(interval));
+        // Sleep in short steps so a signal stops the agent promptly
+        while (agent_running && chrono::steady_clock::now() < next)
+            this_thread::sleep_for(min(chrono::duration_cast<chrono::steady_clock::duration>(chrono::milliseconds(100)),
+                                       next - chrono::steady_clock::now()));
+        if (!agent_running)
+            break;
+        if (host_info_stale.exchange(false))
+            sampler.invalidateHostInfo();
+
+        shared_ptr<const Snapshot> snap = sampler.latest();
+        if (snap->sequence == lastSequence)
+            continue;
+        lastSequence = snap->sequence;
+        // The first process scan has no CPU usage yet; emit from the second on
+        if (snap->processes->scan < 2)
+            continue;
+        // Without a stream, snapshots only go to the recorder, exporter or shm
+        if (!stream)
+        {
+            if (count > 0)
+                count--;
+            continue;
+        }
+
+        buffer.clear();
+        if (format == SNAPSHOT_BINARY && !headerWritten)
+        {
+            serializeBinaryHeader(*snap->host, buffer);
+            headerWritten = true;
+        }
+        serializeSnapshot(*snap, format, buffer);
+        if (fwrite(buffer.data(), 1, buffer.size(), output) != buffer.size() || fflush(output) != 0)
+            break; // reader went away or the disk is full
+        if (count > 0)
+            count--;
+    }
+
+    exporter.stop();
+    sampler.stop();
+    if (output && output != stdout)
+        fclose(output);
+    return 0;
+}
@@ -0,0 +1,1202 @@
+// Collectors, the sampler and the snapshot formats: everything the GUI and
+// the headless agent share. Includes no ImGui, SDL or OpenGL header, so the
+// agent builds without them.
+#ifndef collector_H
+#define collector_H
+
+#include <stdio.h>
+#include <dirent.h>
+#include <vector>
+#include <iostream>
+#include <cmath>
+// lib to read from file
+#include <fstream>
+// for the name of the computer and the logged in user
+#include <unistd.h>
+#include <limits.h>
+// this is for us to get the cpu information
+// mostly in unix system
+// not sure if it will work in windows
+#include <cpuid.h>
+// this is for the memory usage and other memory visualization
+// for linux gotta find a way for windows
+#include <sys/types.h>
+#include <sys/sysinfo.h>
+#include <sys/statvfs.h>
+// for time and date
+#include <ctime>
+// ifconfig ip addresses
+#include <sys/types.h>
+#include <ifaddrs.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <map>
+#include <unordered_map>
+// background sampling thread
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+#include <cstdarg>
+// rolling window statistics
+#include <deque>
+// persistent /proc readers
+#include <fcntl.h>
+// layout of the shared memory snapshot (a C header, for external readers)
+#include "monitor_shm.h"
+
+using namespace std;
+
+struct CPUStats
+{
+    long long int user;
+    long long int nice;
+    long long int system;
+    long long int idle;
+    long long int iowait;
+    long long int irq;
+    long long int softirq;
+    long long int steal;
+    long long int guest;
+    long long int guestNice;
+};
+
+// /proc/[pid] files a process column can need. The scan only reads the
+// sources requested by the columns currently shown.
+enum ProcSource : unsigned
+{
+    PROC_SOURCE_STAT = 1 << 0,   // /proc/[pid]/stat: name, state, times, vsize, rss
+    PROC_SOURCE_STATUS = 1 << 1, // /proc/[pid]/status: swap
+};
+
+// Parsing kernels for /proc text (parsekernels.cpp). An AVX2 or SSE4.2
+// implementation is picked at runtime from cpuid, with a scalar fallback.
+
+// Returns a pointer to the n-th occurrence (1-based) of c in [p, end), or end
+const char *findNthByte(const char *p, const char *end, char c, size_t n);
+// Decodes up to max unsigned decimal integers from [p, end), treating any
+// other character as a separator and stopping at a newline. *next (if
+// given) is set to where decoding stopped. Returns the number decoded.
+size_t parseUnsignedRun(const char *p, const char *end, unsigned long long *out, size_t max, const char **next = nullptr);
+// "avx2", "sse4.2" or "scalar"
+const char *parseKernelName();
+
+// Field numbers of /proc/[pid]/stat as listed in proc(5), counting pid as 1
+enum StatField
+{
+    STAT_STATE = 3,
+    STAT_PPID = 4,
+    STAT_PGRP = 5,
+    STAT_SESSION = 6,
+    STAT_UTIME = 14,
+    STAT_STIME = 15,
+    STAT_NUM_THREADS = 20,
+    STAT_STARTTIME = 22,
+    STAT_VSIZE = 23,
+    STAT_RSS = 24,
+    STAT_PROCESSOR = 39,
+    STAT_ARG_START = 48,
+};
+
+// StatParser extracts a compile-time list of /proc/[pid]/stat fields in a
+// single forward pass over the text after "(comm) ": the fields in between
+// are skipped with findNthByte() and the wanted ones decoded by hand.
+// Fields must be listed in increasing order; values[i] receives Fields[i].
+// A non-numeric field (the state) yields its first character.
+template <int... Fields>
+struct StatParser
+{
+    static constexpr int count = sizeof...(Fields);
+    static constexpr int fields[count] = {Fields...};
+
+    static constexpr bool ascending()
+    {
+        for (int i = 1; i < count; ++i)
+            if (fields[i] <= fields[i - 1])
+                return false;
+        return fields[0] >= STAT_STATE;
+    }
+    static_assert(count > 0 && ascending(), "stat fields must be listed once, in increasing order, after comm");
+
+    // Returns false if the line ends before the last requested field
+    static bool parse(const char *p, const char *end, long long (&values)[count])
+    {
+        int field = STAT_STATE;
+        for (int i = 0; i < count; ++i)
+        {
+            // Skip the fields in between
+            if (field < fields[i])
+            {
+                p = findNthByte(p, end, ' ', fields[i] - field);
+                if (p == end)
+                    return false;
+                p++;
+                field = fields[i];
+            }
+
+            bool negative = *p == '-';
+            p += negative;
+            unsigned digit = (unsigned char)*p - '0';
+            if (digit > 9)
+            {
+                if (!*p)
+                    return false;
+                values[i] = (unsigned char)*p;
+            }
+            else
+            {
+                unsigned long long value = 0;
+                while (digit <= 9)
+                {
+                    value = value * 10 + digit;
+                    digit = (unsigned char)*++p - '0';
+                }
+                values[i] = negative ? -(long long)value : (long long)value;
+            }
+        }
+        return true;
+    }
+};
+
+// processes `stat`
+struct Proc
+{
+    int pid;
+    int ppid;
+    int pgrp;
+    int session;
+    string name;
+    char state;
+    long long int vsize;
+    long long int rss;  // kB
+    long long int swap; // kB, only with PROC_SOURCE_STATUS
+    long long int utime;
+    long long int stime;
+    long long int starttime;
+    long long int argStart; // where exec() put argv; 0 without ptrace access
+    float cpuUsage; // filled in by ProcessTable::update
+};
+
+struct IP4
+{
+    char name[IF_NAMESIZE];
+    char addressBuffer[INET_ADDRSTRLEN];
+};
+
+struct Networks
+{
+    vector<IP4> ip4s;
+};
+
+struct TX
+{
+    unsigned long long bytes;
+    int packets;
+    int errs;
+    int drop;
+    int fifo;
+    int frame;
+    int compressed;
+    int multicast;
+};
+
+struct RX
+{
+    unsigned long long bytes;
+    int packets;
+    int errs;
+    int drop;
+    int fifo;
+    int colls;
+    int carrier;
+    int compressed;
+};
+
+
+// ProcFile keeps a /proc or /sys file open and rereads it with pread()
+// into a buffer owned by the reader, so sampling a file costs a single
+// syscall instead of open/read/close plus iostream setup every time.
+// The buffer only grows if the file outgrows it. Not thread-safe: each
+// reader belongs to the thread that samples it.
+class ProcFile
+{
+public:
+    explicit ProcFile(const char *path);
+    ~ProcFile();
+    ProcFile(const ProcFile &) = delete;
+    ProcFile &operator=(const ProcFile &) = delete;
+
+    // Rereads the file from offset 0. Returns the NUL-terminated contents
+    // (valid until the next read) or nullptr if the file can't be read.
+    const char *read(size_t *length = nullptr);
+    bool isOpen() const { return fd >= 0; }
+
+private:
+    bool open();
+
+    string path;
+    int fd;
+    vector<char> buffer;
+};
+
+// ProcDir enumerates processes by reading /proc with getdents64 into a
+// large buffer, and opens per-process files with openat() relative to a
+// /proc directory fd, so a scan builds no path strings and does no
+// absolute path lookups. Not thread-safe for listPids(); readFile() only
+// uses the shared fd and can be called from any thread.
+class ProcDir
+{
+public:
+    ProcDir();
+    // A directory laid out like /proc, e.g. /proc/<pid>/task (whose entries
+    // are thread ids); prints nothing if it can't be opened, check fd()
+    explicit ProcDir(const char *path);
+    ~ProcDir();
+    ProcDir(const ProcDir &) = delete;
+    ProcDir &operator=(const ProcDir &) = delete;
+
+    // Replaces pids with every process id currently in /proc (every thread
+    // id, for a task directory). Returns false if it can't be read.
+    bool listPids(vector<int> &pids);
+
+    // Reads /proc/<pid>/<file> into buf and NUL-terminates it.
+    // Returns the number of bytes read, or -1 if the process is gone.
+    ssize_t readFile(int pid, const char *file, char *buf, size_t size) const;
+
+    int fd() const { return dirfd; }
+
+private:
+    int dirfd;
+    vector<char> dents;
+};
+
+// WorkerPool keeps a few threads parked and runs batches of independent
+// tasks on them. run() hands out task indices through an atomic counter,
+// so each task can write its own output slot without locking, and the
+// calling thread takes tasks too until the batch is done.
+class WorkerPool
+{
+public:
+    explicit WorkerPool(unsigned workers);
+    ~WorkerPool();
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    // Calls fn(i) for every i in [0, taskCount) and returns once all are done
+    void run(size_t taskCount, const function<void(size_t)> &fn);
+    unsigned size() const { return (unsigned)threads.size(); }
+
+private:
+    void workerLoop();
+    void drain();
+
+    vector<thread> threads;
+    mutex m;
+    condition_variable started;
+    condition_variable finished;
+    const function<void(size_t)> *task;
+    size_t count;
+    atomic<size_t> next;
+    size_t active;
+    unsigned long generation;
+    bool stopping;
+};
+
+// student TODO : system stats
+string CPUinfo();
+const char *getOsName();
+string getLoggedInUser();
+string getHostname();
+float getSystemUptime();
+
+// Host facts that don't change while the monitor runs (or change rarely,
+// like the hostname). Gathered once by readHostInfo(); CPUinfo()'s cpuid
+// loop traps in VMs, so it must not run per frame or per sample.
+struct HostInfo
+{
+    string osName;
+    string cpuType;
+    string hostname;
+    string loggedInUser;
+};
+
+HostInfo readHostInfo();
+// Cheap uname() check; true (and the new name in hostname) if it changed
+bool hostnameChanged(const HostInfo &info, string &hostname);
+
+// Handle of one series in a MetricsStore
+typedef int SeriesId;
+
+// RollingStats keeps statistics of the samples in a sliding window, in
+// O(1) amortized per sample: min/max from monotonic deques, mean and
+// variance from running sums, and quantiles from a log-bucketed histogram
+// (about 1% relative error). Samples leave in the order they came in.
+class RollingStats
+{
+public:
+    RollingStats();
+
+    void add(unsigned long long seq, float value);
+    // seq must be the oldest sample still in the window
+    void remove(unsigned long long seq, float value);
+    void clear();
+
+    size_t count() const { return n; }
+    float minimum() const;
+    float maximum() const;
+    float mean() const;
+    float stddev() const;
+    // q in [0, 1]; clamped to the exact window min/max
+    float quantile(float q) const;
+
+private:
+    static int bucketFor(float value);
+
+    deque<pair<unsigned long long, float>> minQueue; // increasing values
+    deque<pair<unsigned long long, float>> maxQueue; // decreasing values
+    double sum;
+    double sumSquares;
+    size_t n;
+    vector<unsigned> buckets;
+};
+
+// Largest-Triangle-Three-Buckets: picks `threshold` of the points (x, y)
+// that keep the line's visual shape, so a plot needs at most one point per
+// pixel. Copies y unchanged when it is already small enough.
+void downsampleLTTB(const vector<double> &x, const vector<float> &y, size_t threshold, vector<float> &out);
+
+// Summary of a series over its statistics window
+struct WindowStats
+{
+    size_t count;
+    float min;
+    float max;
+    float mean;
+    float stddev;
+    float p50;
+    float p95;
+    float p99;
+};
+
+// MetricsStore keeps the plot histories: one ring per series with a
+// timestamp column and a value column, each a contiguous array. The
+// sampler appends in O(1); readers copy out a time window. Every series
+// has its own mutex, so a reader only ever waits for one append.
+class MetricsStore
+{
+public:
+    // Samples kept per series (32768: ~9 min at 60 Hz, ~9 h at 1 Hz, 384 KiB per series)
+    static const size_t DEFAULT_RETENTION = 32768;
+    static const int MAX_SERIES = 256;
+
+    explicit MetricsStore(size_t retention = DEFAULT_RETENTION);
+    MetricsStore(const MetricsStore &) = delete;
+    MetricsStore &operator=(const MetricsStore &) = delete;
+
+    // Registers a series; returns -1 when MAX_SERIES are in use
+    SeriesId addSeries();
+    size_t seriesCount() const { return count.load(memory_order_acquire); }
+
+    // Timestamps must not decrease (seconds on any monotonic clock)
+    void append(SeriesId id, double timestamp, float value);
+
+    // Copies the samples with since <= timestamp <= until, oldest first.
+    // Returns the number copied.
+    size_t read(SeriesId id, double since, vector<double> &times, vector<float> &values) const
+    {
+        return read(id, since, HUGE_VAL, times, values);
+    }
+    size_t read(SeriesId id, double since, double until, vector<double> &times, vector<float> &values) const;
+    bool last(SeriesId id, double &timestamp, float &value) const;
+    // Bumped by every append, so readers can tell when a cache is stale
+    unsigned long long version(SeriesId id) const;
+
+    // Rolling statistics cover the samples of the last `seconds` (capped
+    // by the retention), updated on every append
+    static constexpr double DEFAULT_WINDOW = 10.0;
+    void setWindow(SeriesId id, double seconds);
+    WindowStats stats(SeriesId id) const;
+
+private:
+    struct Series
+    {
+        mutable mutex lock;
+        vector<double> times;
+        vector<float> values;
+        size_t head = 0; // next slot to write
+        size_t size = 0;
+        unsigned long long version = 0;
+
+        // The newest windowCount samples are in stats; they carry the
+        // sequence numbers nextSeq - windowCount .. nextSeq - 1
+        double window = DEFAULT_WINDOW;
+        size_t windowCount = 0;
+        unsigned long long nextSeq = 0;
+        RollingStats stats;
+    };
+
+    Series *get(SeriesId id) const;
+    static void evictOutsideWindow(Series &s, double newest);
+    static void rebuildStats(Series &s);
+
+    size_t retention;
+    mutable mutex addMutex; // serializes addSeries()
+    unique_ptr<Series> series[MAX_SERIES];
+    atomic<size_t> count;
+};
+
+// Columns of a /proc/stat cpu line, in file order
+enum CpuMode
+{
+    CPU_USER,
+    CPU_NICE,
+    CPU_SYSTEM,
+    CPU_IDLE,
+    CPU_IOWAIT,
+    CPU_IRQ,
+    CPU_SOFTIRQ,
+    CPU_STEAL,
+    CPU_GUEST,      // already counted in user
+    CPU_GUEST_NICE, // already counted in nice
+    CPU_MODE_COUNT
+};
+
+const char *cpuModeName(CpuMode mode);
+
+// Share of one CPU's time over the last sample, in percent
+struct CpuCoreUsage
+{
+    int id; // N of the cpuN line, -1 for the aggregate "cpu" line
+    float busy;
+    float mode[CPU_MODE_COUNT];
+};
+
+// Reads every cpu line of /proc/stat in one pass. Counters are kept as a
+// structure of arrays (one array per mode, index 0 = aggregate, i + 1 =
+// i-th core line) so the delta and percentage loops run over contiguous
+// memory and vectorize.
+class CpuStatsEngine
+{
+public:
+    explicit CpuStatsEngine(const char *path = "/proc/stat");
+
+    // Rereads /proc/stat and updates the usage since the previous sample
+    bool sample();
+
+    size_t coreCount() const { return ids.empty() ? 0 : ids.size() - 1; }
+    CpuCoreUsage total() const { return usage(0); }
+    CpuCoreUsage core(size_t i) const { return usage(i + 1); }
+    // Raw aggregate counters of the last sample
+    CPUStats counters() const;
+
+private:
+    CpuCoreUsage usage(size_t index) const;
+
+    ProcFile file;
+    vector<int> ids;
+    vector<unsigned long long> current[CPU_MODE_COUNT];
+    vector<unsigned long long> previous[CPU_MODE_COUNT];
+    vector<float> percent[CPU_MODE_COUNT];
+    vector<float> busy;
+    vector<unsigned long long> scratch; // elapsed ticks per line
+};
+string getFanStatus();
+float getFanSpeed();
+float getCPUTemperature();
+
+enum SensorType
+{
+    SENSOR_FAN,         // RPM
+    SENSOR_TEMPERATURE, // Celsius
+};
+
+struct SensorReading
+{
+    SensorType type;
+    string label;
+    float value;
+};
+
+// SensorRegistry discovers hwmon fans/temperatures and thermal zones once
+// (and again every 30 s, for hot-plugged devices), keeps their input files
+// open and samples them with pread(). Used from the sampler thread only.
+class SensorRegistry
+{
+public:
+    SensorRegistry(const string &hwmonRoot = "/sys/class/hwmon", const string &thermalRoot = "/sys/class/thermal");
+
+    void rescan();
+    bool hasFan();
+    // First fan / first thermal zone (or hwmon temperature), 0 if none
+    float readFanSpeed();
+    float readTemperature();
+    vector<SensorReading> readAll();
+
+private:
+    struct Sensor
+    {
+        SensorType type;
+        string label;
+        float scale; // raw value to RPM / Celsius
+        float value; // last reading
+        unique_ptr<ProcFile> file;
+    };
+
+    void addSensor(SensorType type, const string &label, const string &path, float scale);
+    void rescanIfStale();
+    float read(Sensor &sensor);
+
+    string hwmonRoot;
+    string thermalRoot;
+    vector<Sensor> entries;
+    int fan;
+    int temperature;
+    bool scanned;
+    chrono::steady_clock::time_point lastScan;
+};
+
+SensorRegistry &sensorRegistry();
+
+// Raw /proc/meminfo values in kB, filled in a single pass by readMemInfo().
+// Fields missing on the running kernel stay 0.
+struct MemInfoFields
+{
+    long long memTotal;
+    long long memFree;
+    long long memAvailable;
+    long long buffers;
+    long long cached;
+    long long swapCached;
+    long long active;
+    long long inactive;
+    long long activeAnon;
+    long long inactiveAnon;
+    long long activeFile;
+    long long inactiveFile;
+    long long unevictable;
+    long long mlocked;
+    long long swapTotal;
+    long long swapFree;
+    long long dirty;
+    long long writeback;
+    long long anonPages;
+    long long mapped;
+    long long shmem;
+    long long kReclaimable;
+    long long slab;
+    long long sReclaimable;
+    long long sUnreclaim;
+    long long kernelStack;
+    long long pageTables;
+    long long commitLimit;
+    long long committedAS;
+    long long vmallocUsed;
+    long long anonHugePages;
+    long long shmemHugePages;
+    long long hugePagesTotal;
+    long long hugePagesFree;
+    long long hugepagesize;
+};
+
+// Memory information structures
+struct MemoryInfo {
+    double totalGB;
+    double usedGB;
+    double freeGB;
+    double availableGB;
+    double buffCacheGB;
+    double dirtyGB;
+    double writebackGB;
+    double slabGB;
+    double shmemGB;
+    double anonHugePagesGB;
+    float usagePercent;
+};
+
+struct SwapInfo {
+    double totalGB;
+    double usedGB;
+    double freeGB;
+    float usagePercent;
+};
+
+struct DiskInfo {
+    double totalGB;
+    double usedGB;
+    double availableGB;
+    float usagePercent;
+};
+
+// student TODO : memory and processes
+float getMemoryUsage();
+MemInfoFields readMemInfo();
+MemoryInfo getDetailedMemoryInfo();
+MemoryInfo getDetailedMemoryInfo(const MemInfoFields &fields);
+float getSwapUsage();
+SwapInfo getDetailedSwapInfo();
+SwapInfo getDetailedSwapInfo(const MemInfoFields &fields);
+float getDiskUsage();
+DiskInfo getDetailedDiskInfo();
+vector<Proc> getAllProcesses();
+void getAllProcesses(vector<Proc> &processes, unsigned sources = PROC_SOURCE_STAT);
+float calculateProcessCPUUsage(const Proc &p, const Proc &prev_p, const CPUStats &prev_cpu, const CPUStats &current_cpu);
+float calculateCPUTimeUsage(long long processCPUTimeDelta, const CPUStats &prev_cpu, const CPUStats &current_cpu);
+
+// student TODO : network
+vector<IP4> getIPv4Addresses();
+void getNetStats(map<string, RX> &rxStats, map<string, TX> &txStats);
+string formatBytes(long long bytes);
+
+// Per-process state kept across scans by ProcessTable
+struct ProcessEntry
+{
+    Proc proc;           // latest sample
+    unsigned long seen;  // scan generation that last updated this entry
+};
+
+// ProcessTable keeps one entry per live process in a flat open-addressing
+// hash keyed by pid + starttime (so a recycled pid is a new process).
+// Each scan updates entries in place, reusing their name storage, and
+// entries not seen in the scan are evicted. Lives on the sampler thread.
+class ProcessTable
+{
+public:
+    ProcessTable();
+
+    // Merges a fresh scan: computes each process' CPU usage against its
+    // previous sample, writes it back into scan, and evicts exited processes
+    void update(vector<Proc> &scan, const CPUStats &cpuStats);
+
+    const ProcessEntry *find(int pid, long long starttime) const;
+    size_t size() const { return used; }
+
+    // Processes that appeared / disappeared in the last update
+    const vector<int> &startedPids() const { return started; }
+    const vector<int> &exitedPids() const { return exited; }
+
+private:
+    enum SlotState : unsigned char
+    {
+        SLOT_EMPTY,
+        SLOT_USED,
+        SLOT_DELETED
+    };
+
+    size_t slotFor(int pid, long long starttime) const;
+    size_t insert(const Proc &p);
+    void rehash(size_t capacity);
+
+    vector<ProcessEntry> entries;
+    vector<SlotState> states;
+    size_t used;
+    size_t deleted;
+    unsigned long generation;
+    CPUStats prevCpuStats;
+    bool hasPrevCpuStats;
+    vector<int> started;
+    vector<int> exited;
+};
+
+// A process' place in the process tree, by index into the process list
+// (-1: none), with totals over the process and all its descendants
+struct ProcessTreeNode
+{
+    int parent;
+    int firstChild;
+    int nextSibling;
+    int descendants;
+    float subtreeCpu;
+    long long subtreeRss; // kB
+};
+
+// Process list with per-process CPU usage, refreshed once per process scan.
+// Shared between consecutive snapshots so fast ticks don't copy it.
+struct ProcessSnapshot
+{
+    unsigned long long scan = 0; // 1 for the sampler's first scan (no CPU usage yet); 0 if not sampled live
+    vector<Proc> processes;
+    CPUStats cpuStats = {};
+    vector<ProcessTreeNode> tree; // same indices as processes
+    vector<int> treeRoots;        // processes whose parent isn't listed
+};
+
+// ProcessTree keeps the parent/child links of the process table between
+// scans. Started processes are linked in, exited ones unlinked (their
+// children wait at the root until the scan shows their new parent), and
+// only a process whose ppid changed is moved. Subtree CPU and RSS totals
+// are recomputed bottom-up only along branches where something changed.
+// Lives on the sampler thread.
+class ProcessTree
+{
+public:
+    ProcessTree();
+
+    // Applies a scan; started/exited come from the ProcessTable update that
+    // produced it (an empty tree can take a whole scan with neither)
+    void update(const vector<Proc> &processes, const vector<int> &started, const vector<int> &exited);
+    // Writes the tree, indexed like the processes last passed to update()
+    void publish(ProcessSnapshot &out) const;
+
+private:
+    struct Node
+    {
+        int pid;
+        int ppid;
+        int parent; // node ids; ROOT is the parent of every top-level process
+        int firstChild;
+        int nextSibling;
+        int prevSibling;
+        int index; // in the last processes passed to update()
+        bool live;
+        bool dirty;
+        float cpu;
+        long long rss;
+        float subtreeCpu;
+        long long subtreeRss;
+        int subtreeCount;
+    };
+    enum { ROOT = 0 };
+
+    int allocate(int pid);
+    void link(int id, int parent);
+    void unlink(int id);
+    void markDirty(int id);
+    void recompute();
+
+    vector<Node> nodes;
+    vector<int> freeNodes;
+    unordered_map<int, int> byPid;
+    vector<pair<int, bool>> stack; // recompute()'s post-order walk
+};
+
+// One thread of a process, from /proc/[pid]/task/[tid]/stat
+struct ThreadInfo
+{
+    int tid;
+    string name;
+    char state;
+    int processor; // CPU it last ran on
+    long long utime;
+    long long stime;
+    long long starttime;
+    float cpuUsage; // same scale as Proc::cpuUsage
+};
+
+// Threads of the processes the UI expanded, by pid
+struct ProcessThreads
+{
+    unordered_map<int, vector<ThreadInfo>> byPid;
+};
+
+// ThreadSampler lists /proc/[pid]/task only for the processes it is asked
+// about, so a collapsed process costs nothing however many threads it has.
+// Each task directory stays open while its process is expanded. Thread CPU
+// usage is the jiffy delta between two refreshes, as for processes.
+// Lives on the sampler thread.
+class ThreadSampler
+{
+public:
+    // Fills out with the threads of pids. Processes sampled before keep
+    // their last threads unless refresh is set; processes not in pids are
+    // forgotten.
+    void sample(const vector<int> &pids, const CPUStats &cpuStats, bool refresh, ProcessThreads &out);
+
+private:
+    struct Task
+    {
+        unique_ptr<ProcDir> dir; // /proc/<pid>/task
+        vector<ThreadInfo> threads; // last refresh, by tid
+        CPUStats cpuStats;
+    };
+
+    unordered_map<int, Task> tasks;
+    vector<int> tids;
+};
+
+// Result of a process search: indices into the process list it ran over
+struct ProcessMatches
+{
+    string query;
+    string error;        // set if the query couldn't run (e.g. a bad regex)
+    vector<int> indices; // ascending
+};
+
+struct SearchTerm;
+
+// ProcessSearch indexes each process' name, command line
+// (/proc/[pid]/cmdline) and owning user, with a trigram index over name and
+// command line. The index follows the process table incrementally: only
+// started processes (or ones that exec()ed or changed owner) are read and
+// indexed, exited ones are dropped. Queries are whitespace-separated terms that must all
+// match: plain text (in name or command line, case-insensitive), name:,
+// cmd:, user: (exact), state: (any of the letters), cpu>N, cpu<N, pid:N,
+// and re:REGEX or /REGEX/.
+class ProcessSearch
+{
+public:
+    ProcessSearch();
+
+    // Brings the index in line with a scan; started/exited come from the
+    // ProcessTable update that produced it
+    void update(const vector<Proc> &processes, const vector<int> &started, const vector<int> &exited);
+    // Indexes processes from scratch without reading /proc (names only; replays)
+    void rebuild(const vector<Proc> &processes);
+    // Runs query over the processes last passed to update() or rebuild()
+    void search(const string &query, const vector<Proc> &processes, ProcessMatches &result);
+    size_t size() const { return byPid.size(); }
+
+private:
+    struct Document
+    {
+        int pid;
+        int index; // in the last processes passed in
+        bool live;
+        uint32_t trigrams;
+        long long starttime;
+        long long argStart;
+        uid_t uid; // (uid_t)-1 if not read
+        string name;
+        string cmdline;
+        string text; // lowercased name + '\n' + command line
+        string user;
+    };
+
+    void add(const Proc &p, int index, bool readProc);
+    void remove(uint32_t id);
+    void compact();
+    bool ownerOf(int pid, uid_t &uid) const;
+    const string &userName(uid_t uid);
+    bool matches(const Document &doc, const Proc &p, const vector<SearchTerm> &terms) const;
+
+    vector<Document> docs;
+    vector<uint32_t> freeDocs;
+    unordered_map<int, uint32_t> byPid;
+    unordered_map<uint32_t, vector<uint32_t>> postings; // trigram -> documents
+    size_t livePostings;
+    size_t stalePostings;
+    ProcDir proc;
+    unordered_map<uid_t, string> userNames;
+    vector<uint32_t> scratch;
+    vector<uint32_t> seen; // per document: stamp of the last query that visited it
+    uint32_t stamp;
+};
+
+// Sensor readings and network counters change once per scan; like the
+// process list, they are shared between the snapshots published until the
+// next scan, so a history tick only copies the CPU and fan values.
+struct SensorSnapshot
+{
+    string fanStatus;
+    vector<SensorReading> readings;
+};
+
+struct NetworkSnapshot
+{
+    vector<IP4> ip4s;
+    map<string, RX> rxStats;
+    map<string, TX> txStats;
+};
+
+// Everything the collectors produced at one point in time.
+// Published by the Sampler and never modified afterwards, so the UI can
+// read it from the render thread without taking any lock.
+struct Snapshot
+{
+    unsigned long long sequence = 0;
+    double timestamp = 0.0; // seconds since the sampler started
+
+    // system
+    shared_ptr<const HostInfo> host;
+    int totalProcesses = 0; // from the last process scan
+    float cpuUsage = 0.0f;
+    CpuCoreUsage cpuTotal = {};
+    vector<CpuCoreUsage> cpuCores;
+    float fanSpeed = 0.0f;
+    float cpuTemperature = 0.0f;
+    shared_ptr<const SensorSnapshot> sensors;
+
+    // memory and processes
+    MemoryInfo memory = {};
+    SwapInfo swap = {};
+    DiskInfo disk = {};
+    shared_ptr<const ProcessSnapshot> processes;
+    // Sampler::setProcessQuery's result over processes; nullptr: no query
+    shared_ptr<const ProcessMatches> processMatches;
+    // Threads of the processes passed to Sampler::setExpandedProcesses
+    // (nullptr: none); not recorded
+    shared_ptr<const ProcessThreads> threads;
+
+    // network
+    shared_ptr<const NetworkSnapshot> network;
+};
+
+class SnapshotRecorder;
+class SharedSnapshotWriter;
+
+// Series the system window plots; registered the same way in the live
+// sampler's store and in a replayed recording's store
+struct PlotSeriesIds
+{
+    SeriesId cpu;
+    SeriesId cpuModes[CPU_MODE_COUNT];
+    SeriesId fan;
+    SeriesId thermal;
+};
+
+PlotSeriesIds registerPlotSeries(MetricsStore &store);
+void appendPlotSamples(MetricsStore &store, const PlotSeriesIds &ids, double timestamp,
+                       const float (&cpuModes)[CPU_MODE_COUNT], float cpuBusy, float fanSpeed, float temperature);
+
+// Sampler runs every collector on a background thread and publishes
+// immutable snapshots. Plot values are sampled at the history rate,
+// everything else (processes, memory, network) once per second.
+class Sampler
+{
+public:
+    // historyRetention: samples kept per plot series (the agent keeps few)
+    explicit Sampler(size_t historyRetention = MetricsStore::DEFAULT_RETENTION);
+    ~Sampler();
+
+    void start();
+    void stop();
+
+    // Latest published snapshot, never null
+    shared_ptr<const Snapshot> latest() const;
+    // Plot histories, timestamped like Snapshot::timestamp
+    const MetricsStore &metrics() const { return store; }
+    const PlotSeriesIds &plotSeries() const { return series; }
+    // Window of the rolling statistics of every series (seconds)
+    void setStatsWindow(double seconds);
+
+    void setPaused(bool paused);
+    void setHistoryRate(float fps);
+    // Time between process/memory/network scans (seconds, default 1)
+    void setScanInterval(double seconds);
+    // ProcSource mask wanted by the visible process columns
+    void setProcessSources(unsigned sources);
+    // Forces the cached host facts to be gathered again on the next scan
+    void invalidateHostInfo();
+    // Records every process-scan snapshot (about 1 Hz); nullptr stops
+    void setRecorder(shared_ptr<SnapshotRecorder> recorder);
+    // Publishes every snapshot into shared memory as well; nullptr stops
+    void setSharedSnapshot(shared_ptr<SharedSnapshotWriter> writer);
+    // Process search (see ProcessSearch) run after every scan and published
+    // as Snapshot::processMatches; an empty query publishes no matches
+    void setProcessQuery(const string &query);
+    // Processes whose threads are read on every scan and published as
+    // Snapshot::threads; an empty list reads none
+    void setExpandedProcesses(const vector<int> &pids);
+    // Called on the sampler thread after each publish (set before start());
+    // the argument is set when only the plot values changed
+    void setPublishCallback(function<void(bool)> callback);
+
+private:
+    void run();
+    void sampleHistory(Snapshot &snap);
+    void sampleSlow(Snapshot &snap);
+    void searchProcesses(Snapshot &snap);
+    void sampleThreads(Snapshot &snap, bool refresh);
+    void publish(Snapshot &snap);
+
+    thread worker;
+    atomic<bool> running;
+    atomic<bool> paused;
+    atomic<float> historyFps;
+    atomic<double> scanInterval;
+    atomic<unsigned> processSources;
+    atomic<bool> hostInfoStale;
+    atomic<bool> queryChanged;
+    mutex queryMutex;
+    string query; // guarded by queryMutex
+    atomic<bool> expandedChanged;
+    mutex expandedMutex;
+    vector<int> expanded; // guarded by expandedMutex
+    mutex wakeMutex;
+    condition_variable wake;
+    shared_ptr<const Snapshot> current;
+    MetricsStore store;
+    PlotSeriesIds series;
+    shared_ptr<SnapshotRecorder> recorder; // atomic_load/atomic_store only
+    shared_ptr<SharedSnapshotWriter> sharedSnapshot; // atomic_load/atomic_store only
+    function<void(bool)> onPublish;
+
+    // sampler thread only
+    CpuStatsEngine cpuEngine;
+    ProcessTable processTable;
+    ProcessSearch processSearch;
+    ProcessTree processTree;
+    ThreadSampler threadSampler;
+    bool searchEnabled;
+    vector<Proc> scan;
+    unsigned long long scans;
+    chrono::steady_clock::time_point lastHostPoll;
+    chrono::steady_clock::time_point startTime;
+};
+
+// Snapshot serialization, for shipping snapshots out of the process
+// (the headless agent's output stream, recordings).
+enum SnapshotFormat
+{
+    SNAPSHOT_JSON,   // one JSON object per line (NDJSON)
+    SNAPSHOT_BINARY, // length-prefixed records in host byte order
+};
+
+// A binary stream starts with the magic, the version and the host facts
+// (four length-prefixed strings); every record starts with the record
+// magic and the byte length of the rest of the record.
+static const uint32_t SNAPSHOT_STREAM_MAGIC = 0x4e4f4d53; // "SMON"
+static const uint32_t SNAPSHOT_STREAM_VERSION = 3;
+static const uint32_t SNAPSHOT_RECORD_MAGIC = 0x50414e53; // "SNAP"
+
+void serializeBinaryHeader(const HostInfo &host, string &out);
+// Appends one snapshot to out
+void serializeSnapshot(const Snapshot &snap, SnapshotFormat format, string &out);
+// Inverse of the binary encoding; false if the data is truncated or corrupt
+bool deserializeBinaryHeader(const char *data, size_t length, HostInfo &host, size_t &headerLength);
+bool deserializeSnapshot(const char *data, size_t length, Snapshot &snap);
+
+// One fixed-size entry per recorded snapshot in PATH.idx: where the record
+// is, plus the plotted values so a replay can draw its plots from the
+// index alone.
+struct RecordingIndexEntry
+{
+    double wallTime; // CLOCK_REALTIME seconds when recorded, never decreasing
+    uint64_t offset; // record start in the data file
+    uint32_t length; // record bytes
+    float cpuBusy;
+    float cpuMode[CPU_MODE_COUNT];
+    float fanSpeed;
+    float temperature;
+    float memoryPercent;
+    float swapPercent;
+};
+static_assert(sizeof(RecordingIndexEntry) == 80, "RecordingIndexEntry is an on-disk format");
+
+// Appends snapshots to a recording (PATH plus PATH.idx); reopening an
+// existing recording continues it. Used from one thread at a time.
+class SnapshotRecorder
+{
+public:
+    SnapshotRecorder();
+    ~SnapshotRecorder();
+    SnapshotRecorder(const SnapshotRecorder &) = delete;
+    SnapshotRecorder &operator=(const SnapshotRecorder &) = delete;
+
+    // Refuses (and says why in error) to continue a recording of another
+    // format version or another host
+    bool open(const string &path, string &error);
+    void close();
+    bool isOpen() const { return dataFd >= 0; }
+    bool record(const Snapshot &snap);
+
+private:
+    int dataFd;
+    int indexFd;
+    uint64_t dataSize;
+    double lastWallTime; // of the last entry; entries never go back in time
+    string buffer; // reused between records
+};
+
+// Read-only view of a recording: both files are mmapped, the index is
+// binary-searched by wall time and records are decoded on demand.
+class SnapshotRecording
+{
+public:
+    SnapshotRecording();
+    ~SnapshotRecording();
+    SnapshotRecording(const SnapshotRecording &) = delete;
+    SnapshotRecording &operator=(const SnapshotRecording &) = delete;
+
+    bool open(const string &path, string &error);
+    void close();
+    bool isOpen() const { return count > 0; }
+
+    size_t size() const { return count; }
+    const RecordingIndexEntry &entry(size_t i) const { return entries[i]; }
+    const HostInfo &host() const { return hostInfo; }
+    // Last entry recorded at or before wallTime (the first if none)
+    size_t find(double wallTime) const;
+    bool load(size_t i, Snapshot &snap) const;
+
+private:
+    const char *data;
+    size_t dataLength;
+    const char *index;
+    size_t indexLength;
+    const RecordingIndexEntry *entries;
+    size_t count;
+    HostInfo hostInfo;
+};
+
+// OpenMetricsExporter serves the latest published snapshot as OpenMetrics
+// text on http://127.0.0.1:PORT/metrics from its own thread. Scrapes only
+// serialize (into a reused, pre-sized buffer); they never trigger a /proc
+// walk of their own.
+class OpenMetricsExporter
+{
+public:
+    // topProcesses: how many of the busiest processes get their own series
+    explicit OpenMetricsExporter(size_t topProcesses = 20);
+    ~OpenMetricsExporter();
+    OpenMetricsExporter(const OpenMetricsExporter &) = delete;
+    OpenMetricsExporter &operator=(const OpenMetricsExporter &) = delete;
+
+    // Binds 127.0.0.1:port; source returns the snapshot a scrape reports
+    bool start(unsigned short port, function<shared_ptr<const Snapshot>()> source);
+    void stop();
+
+    // Formats snap; the text stays valid until the next render()
+    const char *render(const Snapshot &snap, size_t &size);
+
+private:
+    void serve();
+    void handle(int fd);
+    void append(const char *text, size_t n);
+    void append(const char *text);
+    void appendf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    void appendLabelValue(const string &value);
+    void appendFamily(const char *name, const char *type, const char *unit, const char *help);
+
+    size_t topProcesses;
+    vector<char> buffer;
+    size_t length;
+    vector<const Proc *> top; // reused for the top-N selection
+    function<shared_ptr<const Snapshot>()> snapshots;
+    int listenFd;
+    atomic<bool> running;
+    thread worker;
+};
+
+// SharedSnapshotWriter publishes snapshots into a POSIX shared memory
+// segment laid out as struct monitor_shm (monitor_shm.h), guarded by a
+// seqlock so any number of local readers can copy it without syscalls or
+// coordination. Called from the sampler thread only.
+class SharedSnapshotWriter
+{
+public:
+    SharedSnapshotWriter();
+    ~SharedSnapshotWriter();
+    SharedSnapshotWriter(const SharedSnapshotWriter &) = delete;
+    SharedSnapshotWriter &operator=(const SharedSnapshotWriter &) = delete;
+
+    // Creates (or takes over) the segment name; close() unlinks it
+    bool open(const string &name = MONITOR_SHM_NAME);
+    void close();
+    bool isOpen() const { return shm != nullptr; }
+
+    void publish(const Snapshot &snap);
+
+private:
+    string name;
+    struct monitor_shm *shm;
+    // Unchanged parts are left as they are in the segment
+    shared_ptr<const HostInfo> lastHost;
+    shared_ptr<const ProcessSnapshot> lastProcesses;
+};
+
+#endif
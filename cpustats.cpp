@@ -0,0 +1,129 @@
+#include "collector.h"
+
+static const char *const CPU_MODE_NAMES[CPU_MODE_COUNT] = {
+    "user", "nice", "system", "idle", "iowait", "irq", "softirq", "steal", "guest", "guest_nice"};
+
+const char *cpuModeName(CpuMode mode)
+{
+    return mode >= 0 && mode < CPU_MODE_COUNT ? CPU_MODE_NAMES[mode] : "";
+}
+
+CpuStatsEngine::CpuStatsEngine(const char *path) : file(path)
+{
+}
+
+bool CpuStatsEngine::sample()
+{
+    size_t length;
+    const char *stat = file.read(&length);
+    if (!stat)
+        return false;
+    const char *end = stat + length;
+
+    for (int m = 0; m < CPU_MODE_COUNT; ++m)
+        previous[m].swap(current[m]);
+
+    // The cpu lines come first: "cpu  ..." then "cpu0 ...", "cpu1 ...".
+    // Offline cores have no line, so a hotplug changes the id list.
+    vector<int> lineIds;
+    lineIds.reserve(ids.size());
+    size_t line = 0;
+    const char *p = stat;
+    while (p + 3 < end && memcmp(p, "cpu", 3) == 0)
+    {
+        p += 3;
+        unsigned long long id = 0;
+        bool aggregate = *p == ' ';
+        if (!aggregate && parseUnsignedRun(p, end, &id, 1, &p) != 1)
+            break;
+        unsigned long long values[CPU_MODE_COUNT] = {};
+        parseUnsignedRun(p, end, values, CPU_MODE_COUNT, &p);
+        for (int m = 0; m < CPU_MODE_COUNT; ++m)
+        {
+            if (current[m].size() <= line)
+                current[m].resize(line + 1);
+            current[m][line] = values[m];
+        }
+        lineIds.push_back(aggregate ? -1 : (int)id);
+        line++;
+        p = findNthByte(p, end, '\n', 1);
+        if (p < end)
+            p++;
+    }
+    if (line == 0)
+        return false;
+
+    for (int m = 0; m < CPU_MODE_COUNT; ++m)
+        current[m].resize(line);
+    // Without a matching previous sample there is nothing to diff against
+    if (lineIds != ids)
+    {
+        ids.swap(lineIds);
+        for (int m = 0; m < CPU_MODE_COUNT; ++m)
+            previous[m] = current[m];
+    }
+    for (int m = 0; m < CPU_MODE_COUNT; ++m)
+        percent[m].resize(line);
+    busy.resize(line);
+    scratch.assign(line, 0);
+
+    // Elapsed ticks per line: guest time is already part of user/nice
+    unsigned long long *elapsed = scratch.data();
+    for (int m = 0; m < CPU_GUEST; ++m)
+    {
+        const unsigned long long *cur = current[m].data();
+        const unsigned long long *prev = previous[m].data();
+        for (size_t i = 0; i < line; ++i)
+            elapsed[i] += cur[i] >= prev[i] ? cur[i] - prev[i] : 0;
+    }
+
+    // Share of each mode, then busy = everything but idle and iowait
+    for (int m = 0; m < CPU_MODE_COUNT; ++m)
+    {
+        const unsigned long long *cur = current[m].data();
+        const unsigned long long *prev = previous[m].data();
+        float *out = percent[m].data();
+        for (size_t i = 0; i < line; ++i)
+        {
+            unsigned long long delta = cur[i] >= prev[i] ? cur[i] - prev[i] : 0;
+            out[i] = elapsed[i] ? (float)delta * 100.0f / (float)elapsed[i] : 0.0f;
+        }
+    }
+    const float *idle = percent[CPU_IDLE].data();
+    const float *iowait = percent[CPU_IOWAIT].data();
+    float *out = busy.data();
+    for (size_t i = 0; i < line; ++i)
+        out[i] = scratch[i] ? 100.0f - idle[i] - iowait[i] : 0.0f;
+    return true;
+}
+
+CpuCoreUsage CpuStatsEngine::usage(size_t index) const
+{
+    CpuCoreUsage usage = {};
+    usage.id = -1;
+    if (index >= ids.size())
+        return usage;
+    usage.id = ids[index];
+    usage.busy = busy[index];
+    for (int m = 0; m < CPU_MODE_COUNT; ++m)
+        usage.mode[m] = percent[m][index];
+    return usage;
+}
+
+CPUStats CpuStatsEngine::counters() const
+{
+    CPUStats stats = {};
+    if (ids.empty())
+        return stats;
+    stats.user = current[CPU_USER][0];
+    stats.nice = current[CPU_NICE][0];
+    stats.system = current[CPU_SYSTEM][0];
+    stats.idle = current[CPU_IDLE][0];
+    stats.iowait = current[CPU_IOWAIT][0];
+    stats.irq = current[CPU_IRQ][0];
+    stats.softirq = current[CPU_SOFTIRQ][0];
+    stats.steal = current[CPU_STEAL][0];
+    stats.guest = current[CPU_GUEST][0];
+    stats.guestNice = current[CPU_GUEST_NICE][0];
+    return stats;
+}
@@ -0,0 +1,335 @@
+#include "collector.h"
+#include <algorithm>   // For std::partial_sort
+#include <cerrno>      // For errno
+#include <poll.h>      // For poll
+#include <sys/socket.h> // For socket, bind, listen, accept
+
+// Starting size of the response buffer; a scrape of a host with a few
+// hundred interfaces and cores still fits, so steady-state scrapes never
+// allocate. Grows (once) if a host needs more.
+static const size_t EXPORTER_BUFFER_SIZE = 256 * 1024;
+static const double BYTES_PER_GB = 1024.0 * 1024.0 * 1024.0;
+
+OpenMetricsExporter::OpenMetricsExporter(size_t topProcesses)
+    : topProcesses(topProcesses), length(0), listenFd(-1), running(false)
+{
+    buffer.resize(EXPORTER_BUFFER_SIZE);
+    top.reserve(1024);
+}
+
+OpenMetricsExporter::~OpenMetricsExporter()
+{
+    stop();
+}
+
+// ---------------------------------------------------------------------------
+// Text format: appended in place into the pre-sized buffer
+// ---------------------------------------------------------------------------
+
+void OpenMetricsExporter::append(const char *text, size_t n)
+{
+    if (length + n > buffer.size())
+        buffer.resize(max(buffer.size() * 2, length + n));
+    memcpy(buffer.data() + length, text, n);
+    length += n;
+}
+
+void OpenMetricsExporter::append(const char *text)
+{
+    append(text, strlen(text));
+}
+
+void OpenMetricsExporter::appendf(const char *format, ...)
+{
+    for (;;)
+    {
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(buffer.data() + length, buffer.size() - length, format, args);
+        va_end(args);
+        if (n < 0)
+            return;
+        if (length + n < buffer.size())
+        {
+            length += n;
+            return;
+        }
+        buffer.resize(buffer.size() * 2);
+    }
+}
+
+// Label values escape backslash, double quote and newline
+void OpenMetricsExporter::appendLabelValue(const string &value)
+{
+    for (char c : value)
+    {
+        if (c == '\\')
+            append("\\\\", 2);
+        else if (c == '"')
+            append("\\\"", 2);
+        else if (c == '\n')
+            append("\\n", 2);
+        else
+            append(&c, 1);
+    }
+}
+
+void OpenMetricsExporter::appendFamily(const char *name, const char *type, const char *unit, const char *help)
+{
+    appendf("# TYPE %s %s\n", name, type);
+    if (unit)
+        appendf("# UNIT %s %s\n", name, unit);
+    appendf("# HELP %s %s\n", name, help);
+}
+
+const char *OpenMetricsExporter::render(const Snapshot &snap, size_t &size)
+{
+    length = 0;
+
+    appendFamily("monitor_host", "info", nullptr, "Host facts.");
+    append("monitor_host_info{hostname=\"");
+    appendLabelValue(snap.host->hostname);
+    append("\",os=\"");
+    appendLabelValue(snap.host->osName);
+    append("\",cpu=\"");
+    appendLabelValue(snap.host->cpuType);
+    append("\"} 1\n");
+
+    // CPU: raw counters for rate(), plus the sampler's own percentages
+    const CPUStats &cpu = snap.processes->cpuStats;
+    static const long ticks = sysconf(_SC_CLK_TCK) > 0 ? sysconf(_SC_CLK_TCK) : 100;
+    const long long counters[CPU_MODE_COUNT] = {cpu.user, cpu.nice, cpu.system, cpu.idle, cpu.iowait,
+                                                cpu.irq, cpu.softirq, cpu.steal, cpu.guest, cpu.guestNice};
+    appendFamily("monitor_cpu_seconds", "counter", "seconds", "Time all CPUs spent in each mode.");
+    for (int m = 0; m < CPU_MODE_COUNT; ++m)
+        appendf("monitor_cpu_seconds_total{mode=\"%s\"} %.2f\n", cpuModeName((CpuMode)m), (double)counters[m] / ticks);
+    appendFamily("monitor_cpu_usage_percent", "gauge", "percent", "Share of CPU time per mode over the last sample.");
+    for (int m = 0; m < CPU_MODE_COUNT; ++m)
+        appendf("monitor_cpu_usage_percent{cpu=\"all\",mode=\"%s\"} %.3f\n", cpuModeName((CpuMode)m), snap.cpuTotal.mode[m]);
+    for (const CpuCoreUsage &core : snap.cpuCores)
+    {
+        for (int m = 0; m < CPU_MODE_COUNT; ++m)
+            appendf("monitor_cpu_usage_percent{cpu=\"%d\",mode=\"%s\"} %.3f\n", core.id, cpuModeName((CpuMode)m), core.mode[m]);
+    }
+    appendFamily("monitor_cpu_busy_percent", "gauge", "percent", "CPU time not idle or waiting for I/O.");
+    appendf("monitor_cpu_busy_percent{cpu=\"all\"} %.3f\n", snap.cpuTotal.busy);
+    for (const CpuCoreUsage &core : snap.cpuCores)
+        appendf("monitor_cpu_busy_percent{cpu=\"%d\"} %.3f\n", core.id, core.busy);
+
+    appendFamily("monitor_sensor_fan_rpm", "gauge", nullptr, "Fan speed.");
+    for (const SensorReading &sensor : snap.sensors->readings)
+    {
+        if (sensor.type != SENSOR_FAN)
+            continue;
+        append("monitor_sensor_fan_rpm{sensor=\"");
+        appendLabelValue(sensor.label);
+        appendf("\"} %.0f\n", sensor.value);
+    }
+    appendFamily("monitor_sensor_temperature_celsius", "gauge", "celsius", "Temperature sensor reading.");
+    for (const SensorReading &sensor : snap.sensors->readings)
+    {
+        if (sensor.type != SENSOR_TEMPERATURE)
+            continue;
+        append("monitor_sensor_temperature_celsius{sensor=\"");
+        appendLabelValue(sensor.label);
+        appendf("\"} %.3f\n", sensor.value);
+    }
+
+    const MemoryInfo &mem = snap.memory;
+    appendFamily("monitor_memory_bytes", "gauge", "bytes", "Physical memory by kind, from /proc/meminfo.");
+    const pair<const char *, double> memory[] = {
+        {"total", mem.totalGB}, {"used", mem.usedGB}, {"free", mem.freeGB}, {"available", mem.availableGB},
+        {"buff_cache", mem.buffCacheGB}, {"dirty", mem.dirtyGB}, {"writeback", mem.writebackGB},
+        {"slab", mem.slabGB}, {"shmem", mem.shmemGB}, {"anon_huge_pages", mem.anonHugePagesGB}};
+    for (const auto &kind : memory)
+        appendf("monitor_memory_bytes{kind=\"%s\"} %.0f\n", kind.first, kind.second * BYTES_PER_GB);
+    appendFamily("monitor_swap_bytes", "gauge", "bytes", "Swap space by kind.");
+    appendf("monitor_swap_bytes{kind=\"total\"} %.0f\n", snap.swap.totalGB * BYTES_PER_GB);
+    appendf("monitor_swap_bytes{kind=\"used\"} %.0f\n", snap.swap.usedGB * BYTES_PER_GB);
+    appendf("monitor_swap_bytes{kind=\"free\"} %.0f\n", snap.swap.freeGB * BYTES_PER_GB);
+    appendFamily("monitor_disk_bytes", "gauge", "bytes", "Root filesystem space by kind.");
+    appendf("monitor_disk_bytes{kind=\"total\"} %.0f\n", snap.disk.totalGB * BYTES_PER_GB);
+    appendf("monitor_disk_bytes{kind=\"used\"} %.0f\n", snap.disk.usedGB * BYTES_PER_GB);
+    appendf("monitor_disk_bytes{kind=\"available\"} %.0f\n", snap.disk.availableGB * BYTES_PER_GB);
+
+    // Network counters, one family per column of /proc/net/dev
+    struct NetCounter
+    {
+        const char *name;
+        const char *help;
+        bool receive;
+        unsigned long long (*value)(const RX &, const TX &);
+    };
+    static const NetCounter netCounters[] = {
+        {"monitor_network_receive_bytes", "Bytes received.", true, [](const RX &r, const TX &) { return (unsigned long long)r.bytes; }},
+        {"monitor_network_receive_packets", "Packets received.", true, [](const RX &r, const TX &) { return (unsigned long long)r.packets; }},
+        {"monitor_network_receive_errors", "Receive errors.", true, [](const RX &r, const TX &) { return (unsigned long long)r.errs; }},
+        {"monitor_network_receive_drop", "Received packets dropped.", true, [](const RX &r, const TX &) { return (unsigned long long)r.drop; }},
+        {"monitor_network_transmit_bytes", "Bytes transmitted.", false, [](const RX &, const TX &t) { return (unsigned long long)t.bytes; }},
+        {"monitor_network_transmit_packets", "Packets transmitted.", false, [](const RX &, const TX &t) { return (unsigned long long)t.packets; }},
+        {"monitor_network_transmit_errors", "Transmit errors.", false, [](const RX &, const TX &t) { return (unsigned long long)t.errs; }},
+        {"monitor_network_transmit_drop", "Transmitted packets dropped.", false, [](const RX &, const TX &t) { return (unsigned long long)t.drop; }},
+    };
+    static const RX noRx = {};
+    static const TX noTx = {};
+    for (const NetCounter &counter : netCounters)
+    {
+        appendFamily(counter.name, "counter", strstr(counter.name, "bytes") ? "bytes" : nullptr, counter.help);
+        for (const auto &rx : snap.network->rxStats)
+        {
+            auto tx = snap.network->txStats.find(rx.first);
+            if (!counter.receive && tx == snap.network->txStats.end())
+                continue;
+            appendf("%s_total{interface=\"", counter.name);
+            appendLabelValue(rx.first);
+            appendf("\"} %llu\n", counter.value(counter.receive ? rx.second : noRx, tx != snap.network->txStats.end() ? tx->second : noTx));
+        }
+    }
+
+    // Processes: the count, then the top N by CPU usage
+    const vector<Proc> &processes = snap.processes->processes;
+    appendFamily("monitor_processes", "gauge", nullptr, "Number of processes.");
+    appendf("monitor_processes %zu\n", processes.size());
+
+    top.clear();
+    for (const Proc &p : processes)
+        top.push_back(&p);
+    size_t n = min(topProcesses, top.size());
+    partial_sort(top.begin(), top.begin() + n, top.end(), [](const Proc *a, const Proc *b) {
+        return a->cpuUsage != b->cpuUsage ? a->cpuUsage > b->cpuUsage : a->pid < b->pid;
+    });
+    appendFamily("monitor_process_cpu_percent", "gauge", "percent", "CPU usage of the busiest processes.");
+    for (size_t i = 0; i < n; ++i)
+    {
+        appendf("monitor_process_cpu_percent{pid=\"%d\",name=\"", top[i]->pid);
+        appendLabelValue(top[i]->name);
+        appendf("\"} %.3f\n", top[i]->cpuUsage);
+    }
+    appendFamily("monitor_process_resident_memory_bytes", "gauge", "bytes", "Resident memory of the busiest processes.");
+    for (size_t i = 0; i < n; ++i)
+    {
+        appendf("monitor_process_resident_memory_bytes{pid=\"%d\",name=\"", top[i]->pid);
+        appendLabelValue(top[i]->name);
+        appendf("\"} %lld\n", top[i]->rss * 1024);
+    }
+
+    append("# EOF\n");
+    size = length;
+    return buffer.data();
+}
+
+// ---------------------------------------------------------------------------
+// HTTP: one connection at a time, GET /metrics only, Connection: close
+// ---------------------------------------------------------------------------
+
+bool OpenMetricsExporter::start(unsigned short port, function<shared_ptr<const Snapshot>()> source)
+{
+    if (running)
+        return false;
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0)
+        return false;
+    int yes = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    // Local only: the endpoint carries process names and has no auth
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listenFd, 16) != 0)
+    {
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+
+    snapshots = move(source);
+    running = true;
+    worker = thread(&OpenMetricsExporter::serve, this);
+    return true;
+}
+
+void OpenMetricsExporter::stop()
+{
+    if (!running.exchange(false))
+        return;
+    worker.join();
+    close(listenFd);
+    listenFd = -1;
+}
+
+static bool sendAll(int fd, const char *data, size_t n)
+{
+    while (n > 0)
+    {
+        ssize_t sent = send(fd, data, n, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        data += sent;
+        n -= sent;
+    }
+    return true;
+}
+
+void OpenMetricsExporter::handle(int fd)
+{
+    // A slow or silent client can't hold the exporter for more than a second
+    struct timeval timeout = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // Only the request line matters; read until it is complete
+    char request[1024];
+    size_t received = 0;
+    while (received < sizeof(request) - 1 && !memchr(request, '\n', received))
+    {
+        ssize_t n = recv(fd, request + received, sizeof(request) - 1 - received, 0);
+        if (n <= 0)
+            return;
+        received += n;
+    }
+    request[received] = '\0';
+
+    char header[256];
+    bool isGet = strncmp(request, "GET ", 4) == 0;
+    bool isMetrics = isGet && (strncmp(request + 4, "/metrics ", 9) == 0 || strncmp(request + 4, "/metrics?", 9) == 0);
+    if (!isMetrics)
+    {
+        const char *status = isGet ? "404 Not Found" : "405 Method Not Allowed";
+        int n = snprintf(header, sizeof(header), "HTTP/1.1 %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", status);
+        sendAll(fd, header, n);
+        return;
+    }
+
+    // Serialize the latest published snapshot; a scrape never walks /proc
+    shared_ptr<const Snapshot> snap = snapshots();
+    size_t size;
+    const char *body = render(*snap, size);
+    int n = snprintf(header, sizeof(header),
+                     "HTTP/1.1 200 OK\r\n"
+                     "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                     "Content-Length: %zu\r\n"
+                     "Connection: close\r\n\r\n",
+                     size);
+    if (sendAll(fd, header, n))
+        sendAll(fd, body, size);
+}
+
+void OpenMetricsExporter::serve()
+{
+    while (running)
+    {
+        // Wake up regularly to notice stop()
+        struct pollfd pfd = {listenFd, POLLIN, 0};
+        if (poll(&pfd, 1, 200) <= 0)
+            continue;
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+            continue;
+        handle(fd);
+        close(fd);
+    }
+}
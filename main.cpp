@@ -45,13 +45,219 @@ using namespace gl;
 #include IMGUI_IMPL_OPENGL_LOADER_CUSTOM
 #endif
 
-static HistoryData cpu_history;
-static HistoryData fan_history;
-static HistoryData thermal_history;
+// Collectors run on the sampler thread; the windows only read its snapshots
+static Sampler sampler;
 static bool plot_paused = false;
 static float history_fps = 60.0f;
 static float network_max_usage_gb = 2.0f; // Default max usage for network visualization in GB
 
+// Render scheduling: the main loop sleeps until input arrives or the sampler
+// publishes, and draws nothing while the window is minimized or hidden.
+// Plot-only publishes (every history tick) wake it at most
+// PLOT_REDRAW_FPS times a second; the plots still get every sample.
+static Uint32 sample_event = (Uint32)-1;       // SDL user event pushed per publish
+static atomic<bool> sample_event_pending(false); // at most one queued at a time
+static atomic<bool> window_visible(true);       // no wake-ups while minimized or hidden
+static const int INPUT_FRAMES = 3;              // ImGui settles layout over a few frames after input
+static const Uint32 IDLE_REDRAW_MS = 1000;      // redraw at least this often while visible
+static const double PLOT_REDRAW_FPS = 15.0;
+static float render_fps = 0.0f;                 // frames actually drawn per second
+
+// Replay of a recording (./monitor --replay FILE): the windows render the
+// recorded snapshots instead of the sampler's, and the plots are drawn from
+// the values in the recording's index.
+struct Replay
+{
+    SnapshotRecording recording;
+    unique_ptr<MetricsStore> store;
+    PlotSeriesIds series;
+    double position = 0.0; // wall time being shown
+    bool playing = true;
+    float speed = 1.0f;
+    size_t loaded = (size_t)-1;
+    shared_ptr<const Snapshot> snap;
+};
+static unique_ptr<Replay> replay;
+
+// Snapshot the windows render this frame
+static shared_ptr<const Snapshot> currentSnapshot()
+{
+    return replay ? replay->snap : sampler.latest();
+}
+
+// Moves the replay clock and decodes the record it lands on (only when that changes)
+static void advanceReplay(float dt)
+{
+    const SnapshotRecording &rec = replay->recording;
+    double first = rec.entry(0).wallTime;
+    double last = rec.entry(rec.size() - 1).wallTime;
+    if (replay->playing)
+        replay->position += dt * replay->speed;
+    if (replay->position >= last)
+    {
+        replay->position = last;
+        replay->playing = false;
+    }
+    replay->position = max(replay->position, first);
+
+    size_t i = rec.find(replay->position);
+    if (i == replay->loaded)
+        return;
+    auto snap = make_shared<Snapshot>();
+    if (rec.load(i, *snap))
+        replay->snap = snap;
+    else if (!replay->snap)
+        replay->snap = sampler.latest(); // corrupt first record: show an empty snapshot
+    replay->loaded = i;
+}
+
+static bool openReplay(const char *path)
+{
+    auto r = make_unique<Replay>();
+    string error;
+    if (!r->recording.open(path, error))
+    {
+        fprintf(stderr, "Replay: %s\n", error.c_str());
+        return false;
+    }
+    const SnapshotRecording &rec = r->recording;
+    r->store = make_unique<MetricsStore>(rec.size());
+    r->series = registerPlotSeries(*r->store);
+    for (size_t i = 0; i < rec.size(); ++i)
+    {
+        const RecordingIndexEntry &e = rec.entry(i);
+        appendPlotSamples(*r->store, r->series, e.wallTime, e.cpuMode, e.cpuBusy, e.fanSpeed, e.temperature);
+    }
+    r->position = rec.entry(0).wallTime;
+    replay = move(r);
+    advanceReplay(0.0f);
+    return true;
+}
+
+static void formatWallTime(double wallTime, char *buffer, size_t size)
+{
+    time_t seconds = (time_t)wallTime;
+    struct tm local;
+    localtime_r(&seconds, &local);
+    strftime(buffer, size, "%Y-%m-%d %H:%M:%S", &local);
+}
+
+// replayWindow, play/pause, speed and scrub controls for a replay
+void replayWindow(const char *id)
+{
+    ImGui::SetNextWindowSize(ImVec2(600, 0), ImGuiCond_FirstUseEver);
+    ImGui::Begin(id);
+    const SnapshotRecording &rec = replay->recording;
+    double first = rec.entry(0).wallTime;
+    double last = rec.entry(rec.size() - 1).wallTime;
+
+    if (ImGui::Button(replay->playing ? "Pause" : "Play"))
+    {
+        // Playing from the end starts over
+        if (!replay->playing && replay->position >= last)
+            replay->position = first;
+        replay->playing = !replay->playing;
+    }
+    ImGui::SameLine();
+    static const float speeds[] = {0.25f, 0.5f, 1.0f, 2.0f, 4.0f, 16.0f, 60.0f, 600.0f, 3600.0f};
+    char label[32];
+    snprintf(label, sizeof(label), "%gx", replay->speed);
+    ImGui::SetNextItemWidth(100);
+    if (ImGui::BeginCombo("Speed", label))
+    {
+        for (float speed : speeds)
+        {
+            snprintf(label, sizeof(label), "%gx", speed);
+            if (ImGui::Selectable(label, speed == replay->speed))
+                replay->speed = speed;
+        }
+        ImGui::EndCombo();
+    }
+    ImGui::SameLine();
+    char when[64];
+    formatWallTime(replay->position, when, sizeof(when));
+    ImGui::Text("%s  (%zu / %zu)", when, replay->loaded + 1, rec.size());
+
+    ImGui::SetNextItemWidth(-1);
+    ImGui::SliderScalar("##Scrub", ImGuiDataType_Double, &replay->position, &first, &last, "");
+    ImGui::End();
+}
+
+// Plots the last plot_window seconds of a metrics series with its window
+// percentiles in the overlay. A max_value of 0 scales to the window's
+// maximum (rolling, so an old spike stops pinning the scale); history_scale
+// applies on top.
+static float plot_window = 10.0f;
+static float history_scale = 1.0f;
+
+// The points handed to PlotLines are downsampled (LTTB) to the plot's
+// pixel width and cached per widget until the series gets a new sample,
+// the window changes or the widget is resized.
+struct PlotCache
+{
+    SeriesId id = -1;
+    unsigned long long version = 0;
+    float window = 0.0f;
+    double end = 0.0;
+    int width = 0;
+    vector<float> points;
+    WindowStats stats = {};
+};
+
+static void plotSeries(const char *label, SeriesId id, const char *current, float max_value, ImVec2 size)
+{
+    // Scratch buffers reused every frame; the UI thread is the only reader
+    static vector<double> times;
+    static vector<float> values;
+    static map<ImGuiID, PlotCache> caches;
+
+    const MetricsStore &store = replay ? *replay->store : sampler.metrics();
+    PlotCache &cache = caches[ImGui::GetID(label)];
+    unsigned long long version = store.version(id);
+    int width = (int)(size.x > 0.0f ? size.x : ImGui::CalcItemWidth());
+    // Live plots end at the newest sample, replayed ones at the replay clock
+    double end = replay ? replay->position : 0.0;
+    if (cache.id != id || cache.version != version || cache.window != plot_window || cache.end != end || cache.width != width)
+    {
+        double newest;
+        float value;
+        if (replay)
+            store.read(id, end - plot_window, end, times, values);
+        else if (store.last(id, newest, value))
+            store.read(id, newest - plot_window, times, values);
+        else
+            values.clear();
+        downsampleLTTB(times, values, (size_t)max(width, 3), cache.points);
+
+        // The store keeps rolling stats for the live window; a replayed
+        // window ends in the past, so its stats are computed here
+        if (replay)
+        {
+            RollingStats window;
+            for (size_t i = 0; i < values.size(); ++i)
+                window.add(i, values[i]);
+            cache.stats = {window.count(), window.minimum(), window.maximum(), window.mean(), window.stddev(),
+                           window.quantile(0.50f), window.quantile(0.95f), window.quantile(0.99f)};
+        }
+        else
+        {
+            cache.stats = store.stats(id);
+        }
+        cache.id = id;
+        cache.version = version;
+        cache.window = plot_window;
+        cache.end = end;
+        cache.width = width;
+    }
+
+    const WindowStats &stats = cache.stats;
+    char overlay[128];
+    snprintf(overlay, sizeof(overlay), "%s  p50 %.1f  p95 %.1f  p99 %.1f", current, stats.p50, stats.p95, stats.p99);
+    if (max_value <= 0.0f)
+        max_value = stats.max;
+    ImGui::PlotLines(label, cache.points.data(), (int)cache.points.size(), 0, overlay, 0.0f, max_value * history_scale, size);
+}
+
 // systemWindow, display information for the system monitorization
 void systemWindow(const char *id, ImVec2 size, ImVec2 position)
 {
@@ -60,42 +266,105 @@ void systemWindow(const char *id, ImVec2 size, ImVec2 position)
     ImGui::SetWindowPos(id, position);
 
     // student TODO : add code here for the system window
-    ImGui::Text("Operating System: %s", getOsName());
-    ImGui::Text("Logged in User: %s", getLoggedInUser().c_str());
-    ImGui::Text("Hostname: %s", getHostname().c_str());
-    ImGui::Text("Total Processes: %d", getTotalProcesses());
-    ImGui::Text("CPU Type: %s", CPUinfo().c_str());
-
-    static float history_scale = 1.0f;
-
-    ImGui::Checkbox("Pause Plot", &plot_paused);
-    ImGui::SliderFloat("Plot FPS", &history_fps, 1.0f, 120.0f, "%.0f FPS");
+    shared_ptr<const Snapshot> snap = currentSnapshot();
+    const PlotSeriesIds &series = replay ? replay->series : sampler.plotSeries();
+
+    ImGui::Text("Operating System: %s", snap->host->osName.c_str());
+    ImGui::Text("Logged in User: %s", snap->host->loggedInUser.c_str());
+    ImGui::Text("Hostname: %s", snap->host->hostname.c_str());
+    ImGui::Text("Total Processes: %d", snap->totalProcesses);
+    ImGui::Text("CPU Type: %s", snap->host->cpuType.c_str());
+    // The host facts are gathered once; this reads them again
+    if (!replay && ImGui::SmallButton("Refresh system info"))
+        sampler.invalidateHostInfo();
+
+    // Sampling controls only apply to live data; a replay has its own window
+    if (!replay)
+    {
+        if (ImGui::Checkbox("Pause Plot", &plot_paused))
+            sampler.setPaused(plot_paused);
+        if (ImGui::SliderFloat("Plot FPS", &history_fps, 1.0f, 120.0f, "%.0f FPS"))
+            sampler.setHistoryRate(history_fps);
+    }
+    ImGui::Text("Rendering: %.1f FPS", render_fps);
     ImGui::SliderFloat("Plot Y-Scale", &history_scale, 0.1f, 2.0f, "%.1f");
+    // Replays are recorded at 1 Hz, so allow up to a day of history
+    if (ImGui::SliderFloat("Plot Window", &plot_window, 1.0f, replay ? 86400.0f : 600.0f, "%.0f s", ImGuiSliderFlags_Logarithmic))
+        sampler.setStatsWindow(plot_window);
+    char overlay[64];
 
     if (ImGui::BeginTabBar("SystemTabs"))
     {
         if (ImGui::BeginTabItem("CPU"))
         {
             // student TODO: CPU graph and overlay
-            ImGui::PlotLines("##CPU", cpu_history.values.data(), cpu_history.values.size(), cpu_history.offset,
-                             cpu_history.overlay_text.c_str(), 0.0f, 100.0f * history_scale, ImVec2(0, ImGui::GetContentRegionAvail().y));
+            // -1 plots the busy total, anything else one CpuMode
+            static int plot_mode = -1;
+            const char *preview = plot_mode < 0 ? "total" : cpuModeName((CpuMode)plot_mode);
+            if (ImGui::BeginCombo("Plot", preview))
+            {
+                if (ImGui::Selectable("total", plot_mode < 0))
+                    plot_mode = -1;
+                for (int m = 0; m < CPU_MODE_COUNT; ++m)
+                {
+                    if (ImGui::Selectable(cpuModeName((CpuMode)m), plot_mode == m))
+                        plot_mode = m;
+                }
+                ImGui::EndCombo();
+            }
+
+            const CpuCoreUsage &total = snap->cpuTotal;
+            ImGui::Text("user %.1f%%  system %.1f%%  iowait %.1f%%  irq %.1f%%  softirq %.1f%%  steal %.1f%%",
+                        total.mode[CPU_USER] + total.mode[CPU_NICE], total.mode[CPU_SYSTEM], total.mode[CPU_IOWAIT],
+                        total.mode[CPU_IRQ], total.mode[CPU_SOFTIRQ], total.mode[CPU_STEAL]);
+
+            if (plot_mode < 0)
+                snprintf(overlay, sizeof(overlay), "%.1f %%", snap->cpuUsage);
+            else
+                snprintf(overlay, sizeof(overlay), "%s %.1f %%", cpuModeName((CpuMode)plot_mode), total.mode[plot_mode]);
+            plotSeries("##CPU", plot_mode < 0 ? series.cpu : series.cpuModes[plot_mode], overlay,
+                       100.0f, ImVec2(0, ImGui::GetContentRegionAvail().y * 0.5f));
+
+            // One bar per core, so a single hot core isn't averaged away
+            ImGui::BeginChild("Cores");
+            const int bars_per_row = 4;
+            for (size_t i = 0; i < snap->cpuCores.size(); ++i)
+            {
+                const CpuCoreUsage &core = snap->cpuCores[i];
+                char label[64];
+                snprintf(label, sizeof(label), "cpu%d %.0f%% (st %.0f%%)", core.id, core.busy, core.mode[CPU_STEAL]);
+                if (i % bars_per_row)
+                    ImGui::SameLine();
+                ImGui::ProgressBar(core.busy / 100.0f, ImVec2(ImGui::GetContentRegionAvail().x / (bars_per_row - i % bars_per_row) - ImGui::GetStyle().ItemSpacing.x, 0), label);
+            }
+            ImGui::EndChild();
             ImGui::EndTabItem();
         }
         if (ImGui::BeginTabItem("Fan"))
         {
             // student TODO: Fan information and graph
-            ImGui::Text("Status: %s", getFanStatus().c_str());
-            ImGui::Text("Speed: %.0f RPM", getFanSpeed());
-            ImGui::PlotLines("##Fan", fan_history.values.data(), fan_history.values.size(), fan_history.offset,
-                             fan_history.overlay_text.c_str(), 0.0f, fan_history.max_value * history_scale, ImVec2(0, ImGui::GetContentRegionAvail().y));
+            ImGui::Text("Status: %s", snap->sensors->fanStatus.c_str());
+            ImGui::Text("Speed: %.0f RPM", snap->fanSpeed);
+            for (const auto &sensor : snap->sensors->readings)
+            {
+                if (sensor.type == SENSOR_FAN)
+                    ImGui::BulletText("%s: %.0f RPM", sensor.label.c_str(), sensor.value);
+            }
+            snprintf(overlay, sizeof(overlay), "%.0f RPM", snap->fanSpeed);
+            plotSeries("##Fan", series.fan, overlay, 0.0f, ImVec2(0, ImGui::GetContentRegionAvail().y));
             ImGui::EndTabItem();
         }
         if (ImGui::BeginTabItem("Thermal"))
         {
             // student TODO: Thermal information and graph
-            ImGui::Text("Temperature: %.1f C", getCPUTemperature());
-            ImGui::PlotLines("##Thermal", thermal_history.values.data(), thermal_history.values.size(), thermal_history.offset,
-                             thermal_history.overlay_text.c_str(), 0.0f, thermal_history.max_value * history_scale, ImVec2(0, ImGui::GetContentRegionAvail().y));
+            ImGui::Text("Temperature: %.1f C", snap->cpuTemperature);
+            for (const auto &sensor : snap->sensors->readings)
+            {
+                if (sensor.type == SENSOR_TEMPERATURE)
+                    ImGui::BulletText("%s: %.1f C", sensor.label.c_str(), sensor.value);
+            }
+            snprintf(overlay, sizeof(overlay), "%.1f C", snap->cpuTemperature);
+            plotSeries("##Thermal", series.thermal, overlay, 0.0f, ImVec2(0, ImGui::GetContentRegionAvail().y));
             ImGui::EndTabItem();
         }
         ImGui::EndTabBar();
@@ -114,44 +383,6 @@ static int getNumCores() {
     return num_cores;
 }
 
-// Helper to calculate CPU usage for a process (matching 'top' algorithm)
-float calculateProcessCPUUsage(const Proc &p, const Proc &prev_p, const CPUStats &prev_cpu, const CPUStats &current_cpu)
-{
-    // Calculate process CPU time delta (in jiffies)
-    long long processCPUTimeDelta = (p.utime + p.stime) - (prev_p.utime + prev_p.stime);
-
-    // Calculate total system CPU time delta (in jiffies)
-    long long totalSystemTimeDelta = (current_cpu.user - prev_cpu.user) +
-                                     (current_cpu.nice - prev_cpu.nice) +
-                                     (current_cpu.system - prev_cpu.system) +
-                                     (current_cpu.idle - prev_cpu.idle) +
-                                     (current_cpu.iowait - prev_cpu.iowait) +
-                                     (current_cpu.irq - prev_cpu.irq) +
-                                     (current_cpu.softirq - prev_cpu.softirq) +
-                                     (current_cpu.steal - prev_cpu.steal);
-
-    float cpuUsage = 0.0f;
-
-    // Calculate CPU usage percentage like 'top' does
-    if (totalSystemTimeDelta > 0 && processCPUTimeDelta >= 0) {
-        // Get number of CPU cores
-        static int numCores = 0;
-        if (numCores == 0) {
-            numCores = sysconf(_SC_NPROCESSORS_ONLN);
-            if (numCores <= 0) numCores = 1;
-        }
-
-        // CPU usage = (process_cpu_time_delta / total_cpu_time_delta) * 100 * num_cores
-        // This matches the algorithm used by 'top' command more closely
-        cpuUsage = ((float)processCPUTimeDelta / (float)totalSystemTimeDelta) * 100.0f * numCores;
-
-        // Ensure we don't show negative values
-        cpuUsage = std::max(0.0f, cpuUsage);
-    }
-
-    return cpuUsage;
-}
-
 // Helper to calculate memory usage percentage for a process
 float calculateProcessMemoryUsage(const Proc &p, long long totalRam)
 {
@@ -161,15 +392,376 @@ float calculateProcessMemoryUsage(const Proc &p, long long totalRam)
 }
 
 // Helper to format memory size like 'top' command (in KB/MB)
-string formatProcessMemory(long long rssKB)
+void formatProcessMemory(long long rssKB, char *buffer, size_t size)
 {
     if (rssKB < 1024) {
-        return to_string(rssKB) + "k";
+        snprintf(buffer, size, "%lldk", rssKB);
     } else if (rssKB < 1024 * 1024) {
-        return to_string(rssKB / 1024) + "m";
+        snprintf(buffer, size, "%lldm", rssKB / 1024);
     } else {
-        return to_string(rssKB / (1024 * 1024)) + "g";
+        snprintf(buffer, size, "%lldg", rssKB / (1024 * 1024));
+    }
+}
+
+// Columns of the process table and the /proc/[pid] sources each one needs.
+// The sampler only collects the sources of enabled columns.
+struct ProcessColumn
+{
+    const char *name;
+    ImGuiTableColumnFlags flags;
+    unsigned sources;
+};
+
+enum ProcessColumnId
+{
+    COLUMN_SELECT,
+    COLUMN_PID,
+    COLUMN_NAME,
+    COLUMN_STATE,
+    COLUMN_CPU,
+    COLUMN_RES,
+    COLUMN_MEM,
+    COLUMN_SWAP,
+    COLUMN_COUNT
+};
+
+static const ProcessColumn PROCESS_COLUMNS[COLUMN_COUNT] = {
+    {"Select", ImGuiTableColumnFlags_NoSort, 0},
+    {"PID", 0, PROC_SOURCE_STAT},
+    {"Name", 0, PROC_SOURCE_STAT},
+    {"State", 0, PROC_SOURCE_STAT},
+    {"CPU %", ImGuiTableColumnFlags_DefaultSort | ImGuiTableColumnFlags_PreferSortDescending, PROC_SOURCE_STAT},
+    {"RES", ImGuiTableColumnFlags_PreferSortDescending, PROC_SOURCE_STAT},
+    {"MEM %", ImGuiTableColumnFlags_PreferSortDescending, PROC_SOURCE_STAT},
+    {"SWAP", ImGuiTableColumnFlags_DefaultHide | ImGuiTableColumnFlags_PreferSortDescending, PROC_SOURCE_STATUS},
+};
+
+// Text of one process table row, formatted only when its values change
+struct ProcessRowText
+{
+    int pid = -1;
+    float cpu = -1.0f;
+    long long rss = -1;
+    long long swap = -1;
+    char cpuText[16];
+    char resText[16];
+    char memText[16];
+    char swapText[16];
+};
+
+// The rows the process table shows. They are rebuilt when a new scan or
+// new search results arrive, not every frame; rows are then drawn
+// through a list clipper, so only the visible ones cost anything.
+// Sorting is lazy too: rows[0, sorted) are in their final order and the
+// rest is only partial_sort-ed as far as the clipper scrolls, so showing
+// the top of a 30k process list sorts a few dozen rows, not all of them.
+// Expanding a process lists its threads under it; while any process is
+// expanded the table draws from display instead of rows.
+struct ProcessTableView
+{
+    shared_ptr<const ProcessSnapshot> source; // scan the rows were built from
+    shared_ptr<const ProcessMatches> matches; // search results they show (nullptr: all)
+    vector<int> rows;                         // indices into source->processes
+    vector<ProcessRowText> text;              // same indices as source->processes
+    vector<ImGuiTableColumnSortSpecs> sortSpecs;
+    size_t sorted = 0;                        // rows in final order
+    set<int> expanded;                        // pids showing their threads
+    shared_ptr<const ProcessThreads> threads; // threads display was built from
+    vector<pair<int, int>> display;           // (process index, thread or -1)
+    bool displayStale = true;
+};
+static ProcessTableView process_view;
+
+// Rebuilds the visible row list when the scan or the search results changed
+static void updateProcessRows(const shared_ptr<const ProcessSnapshot> &processes, const shared_ptr<const ProcessMatches> &matches)
+{
+    ProcessTableView &view = process_view;
+    if (view.source == processes && view.matches == matches)
+        return;
+    view.source = processes;
+    view.matches = matches;
+    const vector<Proc> &list = processes->processes;
+    if (matches)
+        view.rows = matches->indices;
+    else
+    {
+        view.rows.resize(list.size());
+        for (size_t i = 0; i < list.size(); ++i)
+            view.rows[i] = (int)i;
+    }
+    view.text.resize(list.size());
+    view.sorted = 0;
+    view.displayStale = true;
+}
+
+// Search results for the process table. Live, the sampler searches its
+// incrementally maintained index; a replay has no command lines or users,
+// so its names are indexed here whenever the replayed process list changes.
+static shared_ptr<const ProcessMatches> searchProcesses(const Snapshot &snap, const char *query)
+{
+    if (!replay)
+        return snap.processMatches;
+
+    static ProcessSearch search;
+    static shared_ptr<const ProcessSnapshot> indexed;
+    static shared_ptr<ProcessMatches> matches;
+    if (strspn(query, " \t") == strlen(query))
+        return nullptr;
+    if (indexed != snap.processes)
+    {
+        search.rebuild(snap.processes->processes);
+        indexed = snap.processes;
+        matches = nullptr;
+    }
+    if (!matches || matches->query != query)
+    {
+        matches = make_shared<ProcessMatches>();
+        search.search(query, snap.processes->processes, *matches);
+    }
+    return matches;
+}
+
+// Copies the table's sort specs when the user changed them
+static void updateProcessSort(ImGuiTableSortSpecs *specs)
+{
+    if (!specs || !specs->SpecsDirty)
+        return;
+    process_view.sortSpecs.assign(specs->Specs, specs->Specs + specs->SpecsCount);
+    process_view.sorted = 0;
+    process_view.displayStale = true;
+    specs->SpecsDirty = false;
+}
+
+// Orders two processes by the sort specs, then by PID
+static bool processLess(const Proc &a, const Proc &b)
+{
+    for (const ImGuiTableColumnSortSpecs &spec : process_view.sortSpecs)
+    {
+        int order = 0;
+        switch (spec.ColumnIndex)
+        {
+        case COLUMN_PID:
+            order = (a.pid > b.pid) - (a.pid < b.pid);
+            break;
+        case COLUMN_NAME:
+            order = a.name.compare(b.name);
+            break;
+        case COLUMN_STATE:
+            order = (a.state > b.state) - (a.state < b.state);
+            break;
+        case COLUMN_CPU:
+            order = (a.cpuUsage > b.cpuUsage) - (a.cpuUsage < b.cpuUsage);
+            break;
+        case COLUMN_RES:
+        case COLUMN_MEM:
+            order = (a.rss > b.rss) - (a.rss < b.rss);
+            break;
+        case COLUMN_SWAP:
+            order = (a.swap > b.swap) - (a.swap < b.swap);
+            break;
+        }
+        if (order != 0)
+            return spec.SortDirection == ImGuiSortDirection_Ascending ? order < 0 : order > 0;
+    }
+    return a.pid < b.pid;
+}
+
+// Puts rows[0, count) in final order, sorting a little ahead of what's needed
+static void sortProcessRows(size_t count)
+{
+    ProcessTableView &view = process_view;
+    if (count <= view.sorted || view.sortSpecs.empty())
+        return;
+    const size_t SORT_AHEAD = 64;
+    size_t end = min(view.rows.size(), max(count + SORT_AHEAD, view.sorted * 2));
+    const vector<Proc> &list = view.source->processes;
+    auto less = [&list](int a, int b) { return processLess(list[a], list[b]); };
+    if (end == view.rows.size())
+        sort(view.rows.begin() + view.sorted, view.rows.end(), less);
+    else
+        partial_sort(view.rows.begin() + view.sorted, view.rows.begin() + end, view.rows.end(), less);
+    view.sorted = end;
+}
+
+// Interleaves the threads of expanded processes with the process rows.
+// Thread rows need every process row in place, so this sorts them all;
+// with nothing expanded it does nothing and the lazy sort stays lazy.
+static void updateProcessDisplay(const shared_ptr<const ProcessThreads> &threads)
+{
+    ProcessTableView &view = process_view;
+    if (view.expanded.empty())
+    {
+        view.display.clear();
+        return;
+    }
+    if (!view.displayStale && view.threads == threads)
+        return;
+    view.threads = threads;
+    view.displayStale = false;
+
+    sortProcessRows(view.rows.size());
+    const vector<Proc> &list = view.source->processes;
+    view.display.clear();
+    for (int i : view.rows)
+    {
+        view.display.emplace_back(i, -1);
+        if (!threads || !view.expanded.count(list[i].pid))
+            continue;
+        auto it = threads->byPid.find(list[i].pid);
+        if (it == threads->byPid.end())
+            continue;
+        for (size_t t = 0; t < it->second.size(); ++t)
+            view.display.emplace_back(i, (int)t);
+    }
+}
+
+// Cached row text for processes[i], refreshed if that process's values changed
+static const ProcessRowText &processRowText(int i, long long totalRam)
+{
+    const Proc &p = process_view.source->processes[i];
+    ProcessRowText &text = process_view.text[i];
+    if (text.pid != p.pid || text.cpu != p.cpuUsage || text.rss != p.rss || text.swap != p.swap)
+    {
+        text.pid = p.pid;
+        text.cpu = p.cpuUsage;
+        text.rss = p.rss;
+        text.swap = p.swap;
+        snprintf(text.cpuText, sizeof(text.cpuText), "%.1f", p.cpuUsage);
+        formatProcessMemory(p.rss, text.resText, sizeof(text.resText));
+        snprintf(text.memText, sizeof(text.memText), "%.1f", calculateProcessMemoryUsage(p, totalRam));
+        formatProcessMemory(p.swap, text.swapText, sizeof(text.swapText));
+    }
+    return text;
+}
+
+// Rows of the Tree tab: the top-level processes and the children of every
+// expanded one, depth first with the busiest subtree first. Rebuilt when a
+// new scan arrives or a row is expanded or collapsed.
+struct ProcessTreeRow
+{
+    int index; // into source->processes
+    int depth;
+};
+
+struct ProcessTreeView
+{
+    shared_ptr<const ProcessSnapshot> source;
+    set<int> expanded; // pids
+    bool stale = true;
+    vector<ProcessTreeRow> rows;
+    vector<ProcessTreeRow> stack;
+    vector<int> children;
+};
+static ProcessTreeView tree_view;
+
+static void updateProcessTreeRows(const shared_ptr<const ProcessSnapshot> &processes)
+{
+    ProcessTreeView &view = tree_view;
+    if (view.source == processes && !view.stale)
+        return;
+    view.source = processes;
+    view.stale = false;
+    view.rows.clear();
+
+    const vector<Proc> &list = processes->processes;
+    const vector<ProcessTreeNode> &tree = processes->tree;
+    auto busiestFirst = [&](int a, int b) {
+        if (tree[a].subtreeCpu != tree[b].subtreeCpu)
+            return tree[a].subtreeCpu > tree[b].subtreeCpu;
+        return list[a].pid < list[b].pid;
+    };
+    // Pushes siblings so that the busiest is popped first
+    auto pushSorted = [&](int depth) {
+        sort(view.children.begin(), view.children.end(), busiestFirst);
+        for (auto it = view.children.rbegin(); it != view.children.rend(); ++it)
+            view.stack.push_back({*it, depth});
+    };
+
+    view.stack.clear();
+    view.children = processes->treeRoots;
+    pushSorted(0);
+    while (!view.stack.empty())
+    {
+        ProcessTreeRow row = view.stack.back();
+        view.stack.pop_back();
+        view.rows.push_back(row);
+        if (!view.expanded.count(list[row.index].pid))
+            continue;
+        view.children.clear();
+        for (int child = tree[row.index].firstChild; child != -1; child = tree[child].nextSibling)
+            view.children.push_back(child);
+        pushSorted(row.depth + 1);
+    }
+}
+
+// The Tree tab: processes under their parents, with subtree totals
+static void processTreeTable(const shared_ptr<const ProcessSnapshot> &processes)
+{
+    updateProcessTreeRows(processes);
+    const vector<Proc> &list = processes->processes;
+    const vector<ProcessTreeNode> &tree = processes->tree;
+
+    ImGuiTableFlags flags = ImGuiTableFlags_Resizable | ImGuiTableFlags_Hideable | ImGuiTableFlags_BordersOuter | ImGuiTableFlags_BordersV | ImGuiTableFlags_ScrollY;
+    if (!ImGui::BeginTable("ProcessTree", 7, flags, ImVec2(0, ImGui::GetTextLineHeightWithSpacing() * 15)))
+        return;
+    ImGui::TableSetupColumn("Name", ImGuiTableColumnFlags_NoHide);
+    ImGui::TableSetupColumn("PID");
+    ImGui::TableSetupColumn("CPU %");
+    ImGui::TableSetupColumn("Tree CPU %");
+    ImGui::TableSetupColumn("RES");
+    ImGui::TableSetupColumn("Tree RES");
+    ImGui::TableSetupColumn("Descendants");
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableHeadersRow();
+
+    float indent = ImGui::GetStyle().IndentSpacing;
+    char memory[16];
+    ImGuiListClipper clipper;
+    clipper.Begin((int)tree_view.rows.size());
+    while (clipper.Step())
+    {
+        for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+        {
+            int i = tree_view.rows[row].index;
+            const Proc &p = list[i];
+            const ProcessTreeNode &node = tree[i];
+
+            ImGui::TableNextRow();
+            ImGui::PushID(p.pid);
+            ImGui::TableNextColumn();
+            ImGui::SetCursorPosX(ImGui::GetCursorPosX() + tree_view.rows[row].depth * indent);
+            bool expanded = tree_view.expanded.count(p.pid) > 0;
+            ImGuiTreeNodeFlags nodeFlags = ImGuiTreeNodeFlags_NoTreePushOnOpen | ImGuiTreeNodeFlags_SpanFullWidth;
+            if (node.firstChild == -1)
+                nodeFlags |= ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_Bullet;
+            ImGui::SetNextItemOpen(expanded);
+            if (ImGui::TreeNodeEx("##node", nodeFlags, "%s", p.name.c_str()) != expanded)
+            {
+                if (expanded)
+                    tree_view.expanded.erase(p.pid);
+                else
+                    tree_view.expanded.insert(p.pid);
+                tree_view.stale = true;
+            }
+
+            ImGui::TableNextColumn();
+            ImGui::Text("%d", p.pid);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", p.cpuUsage);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", node.subtreeCpu);
+            ImGui::TableNextColumn();
+            formatProcessMemory(p.rss, memory, sizeof(memory));
+            ImGui::TextUnformatted(memory);
+            ImGui::TableNextColumn();
+            formatProcessMemory(node.subtreeRss, memory, sizeof(memory));
+            ImGui::TextUnformatted(memory);
+            ImGui::TableNextColumn();
+            ImGui::Text("%d", node.descendants);
+            ImGui::PopID();
+        }
     }
+    ImGui::EndTable();
 }
 
 // memoryProcessesWindow, display information for the memory and processes information
@@ -180,15 +772,20 @@ void memoryProcessesWindow(const char *id, ImVec2 size, ImVec2 position)
     ImGui::SetWindowPos(id, position);
 
     // student TODO : add code here for the memory and process information
+    shared_ptr<const Snapshot> snap = currentSnapshot();
 
     // Get detailed memory information
-    MemoryInfo memInfo = getDetailedMemoryInfo();
-    SwapInfo swapInfo = getDetailedSwapInfo();
+    const MemoryInfo &memInfo = snap->memory;
+    const SwapInfo &swapInfo = snap->swap;
 
     // Display memory information like 'free -h'
     ImGui::Text("Memory (RAM):");
     ImGui::Text("  Total: %.1f Gi, Used: %.1f Gi, Free: %.1f Gi, Available: %.1f Gi",
                 memInfo.totalGB, memInfo.usedGB, memInfo.freeGB, memInfo.availableGB);
+    ImGui::Text("  Buff/Cache: %.1f Gi, Shmem: %.2f Gi, Slab: %.2f Gi, AnonHuge: %.2f Gi",
+                memInfo.buffCacheGB, memInfo.shmemGB, memInfo.slabGB, memInfo.anonHugePagesGB);
+    ImGui::Text("  Dirty: %.1f Mi, Writeback: %.1f Mi",
+                memInfo.dirtyGB * 1024.0, memInfo.writebackGB * 1024.0);
     ImGui::Text("  Usage: %.1f%%", memInfo.usagePercent);
     ImGui::ProgressBar(memInfo.usagePercent / 100.0f, ImVec2(0.0f, 0.0f));
 
@@ -204,7 +801,7 @@ void memoryProcessesWindow(const char *id, ImVec2 size, ImVec2 position)
     ImGui::Spacing();
 
     // Display disk information like 'df -h /'
-    DiskInfo diskInfo = getDetailedDiskInfo();
+    const DiskInfo &diskInfo = snap->disk;
 
     // Round values like 'df -h' does
     // df tends to round up used space and available space (conservative estimates)
@@ -218,8 +815,16 @@ void memoryProcessesWindow(const char *id, ImVec2 size, ImVec2 position)
     ImGui::Text("  Usage: %.0f%%", diskInfo.usagePercent);
     ImGui::ProgressBar(diskInfo.usagePercent / 100.0f, ImVec2(0.0f, 0.0f));
 
-    static ImGuiTextFilter filter;
-    filter.Draw("Filter processes", 300);
+    // Searches name, command line and user; see ProcessSearch for the syntax
+    static char search_query[256] = "";
+    ImGui::SetNextItemWidth(300);
+    if (ImGui::InputTextWithHint("Search processes", "text user:NAME state:R cpu>5 pid:N /regex/", search_query, sizeof(search_query)))
+        sampler.setProcessQuery(search_query);
+    shared_ptr<const ProcessMatches> matches = searchProcesses(*snap, search_query);
+    if (matches && !matches->error.empty())
+        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", matches->error.c_str());
+    else if (matches)
+        ImGui::Text("%zu of %zu processes match", matches->indices.size(), snap->processes->processes.size());
 
     ImGui::Separator();
 
@@ -227,104 +832,131 @@ void memoryProcessesWindow(const char *id, ImVec2 size, ImVec2 position)
     {
         if (ImGui::BeginTabItem("Processes"))
         {
-            static vector<Proc> processes;
-            static std::map<int, float> process_cpu_usage;
-            static ImGuiTableFlags flags = ImGuiTableFlags_Resizable | ImGuiTableFlags_Reorderable | ImGuiTableFlags_Hideable | ImGuiTableFlags_BordersOuter | ImGuiTableFlags_BordersV | ImGuiTableFlags_ScrollY;
+            const vector<Proc> &processes = snap->processes->processes;
+            updateProcessRows(snap->processes, matches);
+            static ImGuiTableFlags flags = ImGuiTableFlags_Resizable | ImGuiTableFlags_Reorderable | ImGuiTableFlags_Hideable | ImGuiTableFlags_Sortable | ImGuiTableFlags_SortMulti | ImGuiTableFlags_BordersOuter | ImGuiTableFlags_BordersV | ImGuiTableFlags_ScrollY;
             static std::set<int> selected_pids;
 
-            // Track previous CPU stats for delta calculation
-            static std::map<int, Proc> prev_proc_stats;
-            static bool first_run = true;
-            static float last_update_time = 0.0f;
+            if (ImGui::BeginTable("ProcessesTable", COLUMN_COUNT, flags, ImVec2(0, ImGui::GetTextLineHeightWithSpacing() * 15)))
+            {
+                for (const auto &column : PROCESS_COLUMNS)
+                    ImGui::TableSetupColumn(column.name, column.flags);
+                ImGui::TableSetupScrollFreeze(0, 1);
+                ImGui::TableHeadersRow();
+                updateProcessSort(ImGui::TableGetSortSpecs());
 
-            static CPUStats prev_cpu_stats = {};
+                // Ask the sampler only for what the enabled columns show
+                unsigned sources = 0;
+                for (int column = 0; column < COLUMN_COUNT; ++column)
+                {
+                    if (ImGui::TableGetColumnFlags(column) & ImGuiTableColumnFlags_IsEnabled)
+                        sources |= PROCESS_COLUMNS[column].sources;
+                }
+                sampler.setProcessSources(sources);
 
-            float current_time = ImGui::GetTime();
-            if (current_time - last_update_time > 1.0f)
-            {
-                last_update_time = current_time;
+                // Total RAM for memory usage, from the snapshot's /proc/meminfo (GiB)
+                long long totalRam = (long long)(memInfo.totalGB * 1024.0 * 1024.0 * 1024.0);
 
-                CPUStats current_cpu_stats = getCPUStats();
-                vector<Proc> current_processes = getAllProcesses();
+                updateProcessDisplay(snap->threads);
+                bool drillDown = !process_view.expanded.empty();
+                bool expandedChanged = false;
 
-                if (!first_run)
+                // Only the rows in view are submitted
+                ImGuiListClipper clipper;
+                clipper.Begin((int)(drillDown ? process_view.display.size() : process_view.rows.size()));
+                while (clipper.Step())
                 {
-                    for (const auto &p : current_processes)
+                    if (!drillDown)
+                        sortProcessRows(clipper.DisplayEnd);
+                    for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
                     {
-                        if (prev_proc_stats.count(p.pid) > 0)
+                        int i = drillDown ? process_view.display[row].first : process_view.rows[row];
+                        const Proc &p = processes[i];
+
+                        // A thread of the expanded process above
+                        if (drillDown && process_view.display[row].second >= 0)
                         {
-                            process_cpu_usage[p.pid] = calculateProcessCPUUsage(p, prev_proc_stats.at(p.pid), prev_cpu_stats, current_cpu_stats);
+                            const ThreadInfo &t = process_view.threads->byPid.at(p.pid)[process_view.display[row].second];
+                            ImGui::TableNextRow();
+                            ImGui::TableNextColumn();
+                            ImGui::TableNextColumn();
+                            ImGui::TextDisabled("%d", t.tid);
+                            ImGui::TableNextColumn();
+                            ImGui::Indent();
+                            ImGui::TextUnformatted(t.name.c_str(), t.name.c_str() + t.name.size());
+                            ImGui::SameLine();
+                            ImGui::TextDisabled("on CPU %d", t.processor);
+                            ImGui::Unindent();
+                            ImGui::TableNextColumn();
+                            ImGui::Text("%c", t.state);
+                            ImGui::TableNextColumn();
+                            ImGui::Text("%.1f", t.cpuUsage);
+                            continue;
                         }
-                    }
-                }
-
-                prev_proc_stats.clear();
-                for (const auto &p : current_processes)
-                {
-                    prev_proc_stats[p.pid] = p;
-                }
-                processes = current_processes;
-                prev_cpu_stats = current_cpu_stats;
-                first_run = false;
-            }
-
-            if (ImGui::BeginTable("ProcessesTable", 7, flags, ImVec2(0, ImGui::GetTextLineHeightWithSpacing() * 15)))
-            {
-                ImGui::TableSetupColumn("Select");
-                ImGui::TableSetupColumn("PID");
-                ImGui::TableSetupColumn("Name");
-                ImGui::TableSetupColumn("State");
-                ImGui::TableSetupColumn("CPU %");
-                ImGui::TableSetupColumn("RES");
-                ImGui::TableSetupColumn("MEM %");
-                ImGui::TableHeadersRow();
 
-                // Get total RAM for memory usage calculation
-                struct sysinfo memInfo;
-                sysinfo(&memInfo);
-                long long totalRam = memInfo.totalram * memInfo.mem_unit;
+                        const ProcessRowText &text = processRowText(i, totalRam);
 
-                for (const auto &p : processes)
-                {
-                    if (!filter.PassFilter(p.name.c_str()))
-                        continue;
+                        ImGui::TableNextRow();
+                        ImGui::PushID(p.pid);
 
-                    ImGui::TableNextRow();
+                        // Multi-row selection checkbox
+                        ImGui::TableNextColumn();
+                        bool selected = selected_pids.count(p.pid) > 0;
+                        if (ImGui::Checkbox("##select", &selected))
+                        {
+                            if (selected)
+                                selected_pids.insert(p.pid);
+                            else
+                                selected_pids.erase(p.pid);
+                        }
 
-                    // Multi-row selection checkbox
-                    ImGui::TableNextColumn();
-                    bool selected = selected_pids.count(p.pid) > 0;
-                    if (ImGui::Checkbox(("##select_" + std::to_string(p.pid)).c_str(), &selected))
-                    {
-                        if (selected)
-                            selected_pids.insert(p.pid);
-                        else
-                            selected_pids.erase(p.pid);
-                    }
+                        ImGui::TableNextColumn();
+                        ImGui::Text("%d", p.pid);
+                        // Expanding a process lists its threads under it
+                        ImGui::TableNextColumn();
+                        bool expanded = process_view.expanded.count(p.pid) > 0;
+                        ImGui::SetNextItemOpen(expanded);
+                        if (ImGui::TreeNodeEx("##threads", ImGuiTreeNodeFlags_NoTreePushOnOpen | ImGuiTreeNodeFlags_SpanFullWidth, "%s", p.name.c_str()) != expanded)
+                        {
+                            if (expanded)
+                                process_view.expanded.erase(p.pid);
+                            else
+                                process_view.expanded.insert(p.pid);
+                            process_view.displayStale = true;
+                            expandedChanged = true;
+                        }
+                        ImGui::TableNextColumn();
+                        ImGui::Text("%c", p.state);
+                        ImGui::TableNextColumn();
 
-                    ImGui::TableNextColumn();
-                    ImGui::Text("%d", p.pid);
-                    ImGui::TableNextColumn();
-                    ImGui::Text("%s", p.name.c_str());
-                    ImGui::TableNextColumn();
-                    ImGui::Text("%c", p.state);
-                    ImGui::TableNextColumn();
+                        // Display the stored CPU usage
+                        ImGui::TextUnformatted(text.cpuText);
 
-                    // Display the stored CPU usage
-                    ImGui::Text("%.1f", process_cpu_usage.count(p.pid) ? process_cpu_usage[p.pid] : 0.0f);
+                        ImGui::TableNextColumn();
+                        // Display memory size like 'top' (RES column)
+                        ImGui::TextUnformatted(text.resText);
 
-                    ImGui::TableNextColumn();
-                    // Display memory size like 'top' (RES column)
-                    ImGui::Text("%s", formatProcessMemory(p.rss).c_str());
+                        ImGui::TableNextColumn();
+                        // Display memory percentage like 'top' (%MEM column)
+                        ImGui::TextUnformatted(text.memText);
 
-                    ImGui::TableNextColumn();
-                    // Display memory percentage like 'top' (%MEM column)
-                    ImGui::Text("%.1f", calculateProcessMemoryUsage(p, totalRam));
+                        ImGui::TableNextColumn();
+                        ImGui::TextUnformatted(text.swapText);
+                        ImGui::PopID();
+                    }
                 }
                 ImGui::EndTable();
+                // The sampler reads /proc/[pid]/task for these processes only
+                if (expandedChanged)
+                    sampler.setExpandedProcesses(vector<int>(process_view.expanded.begin(), process_view.expanded.end()));
             }
             ImGui::EndTabItem();
         }
+        if (ImGui::BeginTabItem("Tree"))
+        {
+            processTreeTable(snap->processes);
+            ImGui::EndTabItem();
+        }
         ImGui::EndTabBar();
     }
 
@@ -338,6 +970,8 @@ void networkWindow(const char *id, ImVec2 size, ImVec2 position)
     ImGui::SetWindowSize(id, size);
     ImGui::SetWindowPos(id, position);
 
+    shared_ptr<const Snapshot> snap = currentSnapshot();
+
     // Network Interfaces section
     ImGui::Text("Network Interfaces");
     ImGui::Separator();
@@ -348,8 +982,7 @@ void networkWindow(const char *id, ImVec2 size, ImVec2 position)
         ImGui::TableSetupColumn("IPv4 Address");
         ImGui::TableHeadersRow();
 
-        vector<IP4> ip4s = getIPv4Addresses();
-        for (const auto &ip : ip4s)
+        for (const auto &ip : snap->network->ip4s)
         {
             ImGui::TableNextRow();
             ImGui::TableNextColumn();
@@ -374,7 +1007,7 @@ void networkWindow(const char *id, ImVec2 size, ImVec2 position)
             {
                 if (ImGui::BeginTabItem("RX"))
                 {
-                    map<string, RX> rxStats = getRXStats();
+                    const map<string, RX> &rxStats = snap->network->rxStats;
                     ImGui::Text("RX Usage:");
                     ImGui::Separator();
                     for (const auto &[interface, rx] : rxStats)
@@ -387,7 +1020,7 @@ void networkWindow(const char *id, ImVec2 size, ImVec2 position)
 
                 if (ImGui::BeginTabItem("TX"))
                 {
-                    map<string, TX> txStats = getTXStats();
+                    const map<string, TX> &txStats = snap->network->txStats;
                     ImGui::Text("TX Usage:");
                     ImGui::Separator();
                     for (const auto &[interface, tx] : txStats)
@@ -418,7 +1051,7 @@ void networkWindow(const char *id, ImVec2 size, ImVec2 position)
                     ImGui::TableSetupColumn("Carrier");
                     ImGui::TableHeadersRow();
 
-                    map<string, RX> rxStats = getRXStats();
+                    const map<string, RX> &rxStats = snap->network->rxStats;
                     for (const auto &[interface, rx] : rxStats)
                     {
                         ImGui::TableNextRow();
@@ -449,7 +1082,7 @@ void networkWindow(const char *id, ImVec2 size, ImVec2 position)
                     ImGui::TableSetupColumn("Compressed");
                     ImGui::TableHeadersRow();
 
-                    map<string, TX> txStats = getTXStats();
+                    const map<string, TX> &txStats = snap->network->txStats;
                     for (const auto &[interface, tx] : txStats)
                     {
                         ImGui::TableNextRow();
@@ -472,10 +1105,57 @@ void networkWindow(const char *id, ImVec2 size, ImVec2 position)
     ImGui::End();
 }
 
-
 // Main code
-int main(int, char **)
+int main(int argc, char **argv)
 {
+    // --record FILE appends every sampled snapshot to FILE (+ FILE.idx);
+    // --replay FILE shows a recording instead of live data;
+    // --metrics-port PORT serves the live data on http://127.0.0.1:PORT/metrics;
+    // --shm [NAME] publishes it in shared memory (monitor_shm.h)
+    const char *record_path = nullptr;
+    const char *replay_path = nullptr;
+    int metrics_port = 0;
+    const char *shm_name = nullptr;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            record_path = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            replay_path = argv[++i];
+        else if (strcmp(argv[i], "--metrics-port") == 0 && i + 1 < argc)
+            metrics_port = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--shm") == 0)
+            shm_name = i + 1 < argc && argv[i + 1][0] == '/' ? argv[++i] : MONITOR_SHM_NAME;
+        else
+        {
+            fprintf(stderr, "Usage: %s [--record FILE | --replay FILE] [--metrics-port PORT] [--shm [NAME]]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (replay_path && !openReplay(replay_path))
+        return 1;
+    if (record_path)
+    {
+        auto recorder = make_shared<SnapshotRecorder>();
+        string error;
+        if (!recorder->open(record_path, error))
+        {
+            fprintf(stderr, "Record: %s\n", error.c_str());
+            return 1;
+        }
+        sampler.setRecorder(recorder);
+    }
+    if (shm_name)
+    {
+        auto writer = make_shared<SharedSnapshotWriter>();
+        if (!writer->open(shm_name))
+        {
+            perror(shm_name);
+            return 1;
+        }
+        sampler.setSharedSnapshot(writer);
+    }
+
     // Setup SDL
     // (Some versions of SDL before <2.0.10 appears to have performance/stalling issues on a minority of Windows systems,
     // depending on whether SDL_INIT_GAMECONTROLLER is enabled or disabled.. updating to latest version of SDL is recommended!)
@@ -543,13 +1223,45 @@ int main(int, char **)
     // note : you are free to change the style of the application
     ImVec4 clear_color = ImVec4(0.0f, 0.0f, 0.0f, 0.0f);
 
-    // History data for plots
-    cpu_history.color = ImVec4(0.0f, 1.0f, 0.0f, 1.0f); // Green for CPU
-    fan_history.color = ImVec4(0.0f, 0.5f, 1.0f, 1.0f); // Blue for Fan
-    thermal_history.color = ImVec4(1.0f, 0.0f, 0.0f, 1.0f); // Red for Thermal
+    // Start collecting in the background (a replay needs no live data)
+    sampler.setHistoryRate(history_fps);
+    sampler.setStatsWindow(plot_window);
+    sample_event = SDL_RegisterEvents(1);
+    if (sample_event != (Uint32)-1)
+    {
+        sampler.setPublishCallback([](bool plotOnly) {
+            if (!window_visible)
+                return;
+            // Sampler thread only, so the throttle needs no lock
+            static chrono::steady_clock::time_point last_plot_wake;
+            if (plotOnly)
+            {
+                chrono::steady_clock::time_point now = chrono::steady_clock::now();
+                if (now - last_plot_wake < chrono::duration<double>(1.0 / PLOT_REDRAW_FPS))
+                    return;
+                last_plot_wake = now;
+            }
+            // Coalesced: a frame draws the latest snapshot, however many arrived
+            if (sample_event_pending.exchange(true))
+                return;
+            SDL_Event wake = {};
+            wake.type = sample_event;
+            SDL_PushEvent(&wake);
+        });
+    }
+    OpenMetricsExporter exporter;
+    if (!replay)
+    {
+        sampler.start();
+        if (metrics_port > 0 && !exporter.start(metrics_port, []() { return sampler.latest(); }))
+            fprintf(stderr, "can't listen on 127.0.0.1:%d\n", metrics_port);
+    }
 
     // Main loop
     bool done = false;
+    int frames_wanted = INPUT_FRAMES; // frames still to draw before sleeping again
+    int frames_drawn = 0;
+    Uint32 fps_start = SDL_GetTicks();
     while (!done)
     {
         // Poll and handle events (inputs, window resize, etc.)
@@ -557,16 +1269,49 @@ int main(int, char **)
         // - When io.WantCaptureMouse is true, do not dispatch mouse input data to your main application.
         // - When io.WantCaptureKeyboard is true, do not dispatch keyboard input data to your main application.
         // Generally you may always pass all inputs to dear imgui, and hide them from your application based on those two flags.
+        // Sleep in SDL_WaitEventTimeout unless a frame is already due; a
+        // playing replay advances every frame, so it never sleeps. While
+        // hidden, only an SDL event (e.g. the restore) wakes the loop.
+        bool visible = !(SDL_GetWindowFlags(window) & (SDL_WINDOW_MINIMIZED | SDL_WINDOW_HIDDEN));
+        window_visible = visible;
+        bool animating = visible && replay && replay->playing;
         SDL_Event event;
-        while (SDL_PollEvent(&event))
+        bool busy = visible && (frames_wanted > 0 || animating);
+        bool has_event = busy ? SDL_PollEvent(&event) : visible ? SDL_WaitEventTimeout(&event, IDLE_REDRAW_MS) : SDL_WaitEvent(&event);
+        if (!has_event && frames_wanted == 0)
+            frames_wanted = 1; // idle timeout: one refresh
+        for (; has_event; has_event = SDL_PollEvent(&event))
         {
+            if (event.type == sample_event)
+            {
+                sample_event_pending = false;
+                frames_wanted = max(frames_wanted, 1);
+                continue;
+            }
             ImGui_ImplSDL2_ProcessEvent(&event);
+            frames_wanted = INPUT_FRAMES;
             if (event.type == SDL_QUIT)
                 done = true;
             if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_CLOSE && event.window.windowID == SDL_GetWindowID(window))
                 done = true;
         }
 
+        // Achieved frame rate, over one-second intervals
+        Uint32 ticks = SDL_GetTicks();
+        if (ticks - fps_start >= 1000)
+        {
+            render_fps = frames_drawn * 1000.0f / (ticks - fps_start);
+            frames_drawn = 0;
+            fps_start = ticks;
+        }
+
+        // Nothing is drawn while minimized; SDL wakes the loop on restore
+        if (done || !visible || (frames_wanted == 0 && !animating))
+            continue;
+        if (frames_wanted > 0)
+            frames_wanted--;
+        frames_drawn++;
+
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplSDL2_NewFrame(window);
@@ -574,6 +1319,12 @@ int main(int, char **)
 
         {
             ImVec2 mainDisplay = io.DisplaySize;
+            if (replay)
+            {
+                // A paused replay may have slept: don't jump on the first frame after
+                advanceReplay(min(io.DeltaTime, 0.1f));
+                replayWindow("== Replay ==");
+            }
             memoryProcessesWindow("== Memory and Processes ==",
                                   ImVec2((mainDisplay.x / 2) - 20, (mainDisplay.y / 2) + 30),
                                   ImVec2((mainDisplay.x / 2) + 10, 10));
@@ -587,36 +1338,6 @@ int main(int, char **)
                           ImVec2(10, (mainDisplay.y / 2) + 50));
         }
 
-        // Update history data
-       static float last_update_time = 0.0f;
-       float current_time = ImGui::GetTime();
-       if (!plot_paused && (current_time - last_update_time) > (1.0f/history_fps))
-       {
-            last_update_time = current_time;
-
-            cpu_history.addValue(getCPUUsage());
-            fan_history.addValue(getFanSpeed());
-            thermal_history.addValue(getCPUTemperature());
-       }
-        char buffer[64];
-        
-        if (!cpu_history.values.empty()) {
-            snprintf(buffer, sizeof(buffer), "%.1f %%", cpu_history.values[cpu_history.offset == 0 ? cpu_history.values.size() - 1 : cpu_history.offset - 1]);
-            cpu_history.overlay_text = buffer;
-        }
-
-        if (!fan_history.values.empty()) {
-            snprintf(buffer, sizeof(buffer), "%.0f RPM", fan_history.values[fan_history.offset == 0 ? fan_history.values.size() - 1 : fan_history.offset - 1]);
-            fan_history.overlay_text = buffer;
-        }
-
-        if (!thermal_history.values.empty()) {
-            snprintf(buffer, sizeof(buffer), "%.1f C", thermal_history.values[thermal_history.offset == 0 ? thermal_history.values.size() - 1 : thermal_history.offset - 1]);
-            thermal_history.overlay_text = buffer;
-        }
-
-
-
         // Rendering
         ImGui::Render();
         glViewport(0, 0, (int)io.DisplaySize.x, (int)io.DisplaySize.y);
@@ -627,6 +1348,8 @@ int main(int, char **)
     }
 
     // Cleanup
+    exporter.stop();
+    sampler.stop();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplSDL2_Shutdown();
     ImGui::DestroyContext();
@@ -1,93 +1,148 @@
-#include "header.h"
+#include "collector.h"
 #include <sys/statvfs.h> // For statvfs
-#include <dirent.h>      // For opendir, readdir, closedir
-#include <algorithm>     // For std::remove
-#include <cctype>        // For isdigit
+#include <algorithm>     // For std::remove_if
 
-// Helper function to read a value from a /proc file
-template <typename T>
-T getProcValue(const string &path, const string &key)
+// Helper function to read a "Key:   value" line from a /proc status buffer
+static long long findProcValue(const char *buf, const char *end, const char *key)
 {
-    ifstream file(path);
-    string line;
-    T value = T();
-    while (getline(file, line))
+    size_t keyLength = strlen(key);
+    for (const char *line = buf; line < end; line = findNthByte(line, end, '\n', 1) + 1)
     {
-        if (line.rfind(key, 0) == 0)
-        { // Check if line starts with key
-            size_t colonPos = line.find(":");
-            if (colonPos != string::npos)
+        unsigned long long value = 0;
+        if (strncmp(line, key, keyLength) == 0)
+        {
+            parseUnsignedRun(line + keyLength, end, &value, 1);
+            return value;
+        }
+    }
+    return 0;
+}
+
+// /proc/meminfo is kept open; one read feeds both the memory and swap collectors
+static ProcFile proc_meminfo("/proc/meminfo");
+
+// Compile-time table mapping /proc/meminfo keys to MemInfoFields members,
+// listed in the order the kernel prints them
+struct MemInfoKey
+{
+    const char *name;
+    size_t length;
+    long long MemInfoFields::*field;
+};
+
+#define MEMINFO_KEY(name, field) {name, sizeof(name) - 1, &MemInfoFields::field}
+static constexpr MemInfoKey MEMINFO_KEYS[] = {
+    MEMINFO_KEY("MemTotal", memTotal),
+    MEMINFO_KEY("MemFree", memFree),
+    MEMINFO_KEY("MemAvailable", memAvailable),
+    MEMINFO_KEY("Buffers", buffers),
+    MEMINFO_KEY("Cached", cached),
+    MEMINFO_KEY("SwapCached", swapCached),
+    MEMINFO_KEY("Active", active),
+    MEMINFO_KEY("Inactive", inactive),
+    MEMINFO_KEY("Active(anon)", activeAnon),
+    MEMINFO_KEY("Inactive(anon)", inactiveAnon),
+    MEMINFO_KEY("Active(file)", activeFile),
+    MEMINFO_KEY("Inactive(file)", inactiveFile),
+    MEMINFO_KEY("Unevictable", unevictable),
+    MEMINFO_KEY("Mlocked", mlocked),
+    MEMINFO_KEY("SwapTotal", swapTotal),
+    MEMINFO_KEY("SwapFree", swapFree),
+    MEMINFO_KEY("Dirty", dirty),
+    MEMINFO_KEY("Writeback", writeback),
+    MEMINFO_KEY("AnonPages", anonPages),
+    MEMINFO_KEY("Mapped", mapped),
+    MEMINFO_KEY("Shmem", shmem),
+    MEMINFO_KEY("KReclaimable", kReclaimable),
+    MEMINFO_KEY("Slab", slab),
+    MEMINFO_KEY("SReclaimable", sReclaimable),
+    MEMINFO_KEY("SUnreclaim", sUnreclaim),
+    MEMINFO_KEY("KernelStack", kernelStack),
+    MEMINFO_KEY("PageTables", pageTables),
+    MEMINFO_KEY("CommitLimit", commitLimit),
+    MEMINFO_KEY("Committed_AS", committedAS),
+    MEMINFO_KEY("VmallocUsed", vmallocUsed),
+    MEMINFO_KEY("AnonHugePages", anonHugePages),
+    MEMINFO_KEY("ShmemHugePages", shmemHugePages),
+    MEMINFO_KEY("HugePages_Total", hugePagesTotal),
+    MEMINFO_KEY("HugePages_Free", hugePagesFree),
+    MEMINFO_KEY("Hugepagesize", hugepagesize),
+};
+#undef MEMINFO_KEY
+static constexpr size_t MEMINFO_KEY_COUNT = sizeof(MEMINFO_KEYS) / sizeof(MEMINFO_KEYS[0]);
+
+// Reads /proc/meminfo once into a fixed struct, without allocating.
+// Lines and values are located with the SIMD parsing kernels.
+// Since the kernel prints keys in table order, the lookup for each line
+// starts right after the previous match and almost always hits first try.
+MemInfoFields readMemInfo()
+{
+    MemInfoFields fields = {};
+    size_t length;
+    const char *p = proc_meminfo.read(&length);
+    if (!p)
+        return fields;
+
+    const char *end = p + length;
+    size_t next = 0;
+    while (p < end)
+    {
+        const char *key = p;
+        const char *eol = findNthByte(p, end, '\n', 1);
+        const char *colon = (const char *)memchr(p, ':', eol - p);
+        p = eol + (eol < end);
+        if (!colon)
+            continue;
+        size_t keyLength = colon - key;
+
+        unsigned long long value = 0;
+        parseUnsignedRun(colon + 1, eol, &value, 1);
+
+        for (size_t i = 0; i < MEMINFO_KEY_COUNT; ++i)
+        {
+            const MemInfoKey &k = MEMINFO_KEYS[(next + i) % MEMINFO_KEY_COUNT];
+            if (k.length == keyLength && memcmp(k.name, key, keyLength) == 0)
             {
-                string valStr = line.substr(colonPos + 1);
-                valStr.erase(remove_if(valStr.begin(), valStr.end(), ::isspace), valStr.end());
-                try
-                {
-                    if constexpr (is_same_v<T, int>)
-                        value = stoi(valStr);
-                    else if constexpr (is_same_v<T, long long int>)
-                        value = stoll(valStr);
-                    else if constexpr (is_same_v<T, float>)
-                        value = stof(valStr);
-                    else if constexpr (is_same_v<T, string>)
-                        value = valStr;
-                }
-                catch (...)
-                {
-                    // Conversion error
-                }
+                fields.*k.field = value;
+                next = (next + i + 1) % MEMINFO_KEY_COUNT;
+                break;
             }
-            break;
         }
     }
-    return value;
+    return fields;
 }
 
 // Function to get detailed memory information matching 'free -h' output
 MemoryInfo getDetailedMemoryInfo()
 {
-    MemoryInfo memInfo = {};
-
     // Read from /proc/meminfo for more accurate values like 'free' command
-    ifstream file("/proc/meminfo");
-    string line;
-    map<string, long long> memValues;
-
-    while (getline(file, line)) {
-        size_t colonPos = line.find(":");
-        if (colonPos != string::npos) {
-            string key = line.substr(0, colonPos);
-            string valueStr = line.substr(colonPos + 1);
-
-            // Remove whitespace and "kB" suffix
-            valueStr.erase(remove_if(valueStr.begin(), valueStr.end(), ::isspace), valueStr.end());
-            if (valueStr.find("kB") != string::npos) {
-                valueStr = valueStr.substr(0, valueStr.find("kB"));
-            }
+    return getDetailedMemoryInfo(readMemInfo());
+}
 
-            try {
-                memValues[key] = stoll(valueStr);
-            } catch (...) {
-                // Ignore conversion errors
-            }
-        }
-    }
-    file.close();
+MemoryInfo getDetailedMemoryInfo(const MemInfoFields &fields)
+{
+    MemoryInfo memInfo = {};
 
     // Calculate values in GB (using 1024^3 for binary GB like 'free -h')
     const double GB_FACTOR = 1024.0 * 1024.0;
 
-    long long totalKB = memValues["MemTotal"];
-    long long freeKB = memValues["MemFree"];
-    long long buffersKB = memValues["Buffers"];
-    long long cachedKB = memValues["Cached"];
-    long long sreclaimableKB = memValues["SReclaimable"];
-    long long availableKB = memValues["MemAvailable"];
+    long long totalKB = fields.memTotal;
+    long long freeKB = fields.memFree;
+    long long buffersKB = fields.buffers;
+    long long cachedKB = fields.cached;
+    long long sreclaimableKB = fields.sReclaimable;
+    long long availableKB = fields.memAvailable;
 
 
     memInfo.totalGB = totalKB / GB_FACTOR;
     memInfo.freeGB = freeKB / GB_FACTOR;
     memInfo.buffCacheGB = (buffersKB + cachedKB + sreclaimableKB) / GB_FACTOR;
     memInfo.availableGB = availableKB / GB_FACTOR;
+    memInfo.dirtyGB = fields.dirty / GB_FACTOR;
+    memInfo.writebackGB = fields.writeback / GB_FACTOR;
+    memInfo.slabGB = fields.slab / GB_FACTOR;
+    memInfo.shmemGB = fields.shmem / GB_FACTOR;
+    memInfo.anonHugePagesGB = fields.anonHugePages / GB_FACTOR;
 
     // Calculate used memory exactly like modern 'free' command does:
     // used = MemTotal - MemAvailable
@@ -111,146 +166,170 @@ float getMemoryUsage()
     return memInfo.usagePercent;
 }
 
+// Smallest number of PIDs handed to one scan task
+static const size_t PROCESS_SCAN_CHUNK = 128;
+
+// Fields read from /proc/[pid]/stat, in the order they land in values[]
+using ProcStatParser = StatParser<STAT_STATE, STAT_PPID, STAT_PGRP, STAT_SESSION, STAT_UTIME, STAT_STIME,
+                                  STAT_STARTTIME, STAT_VSIZE, STAT_RSS>;
+// Kernels before 3.5 end the line before arg_start
+using ProcArgParser = StatParser<STAT_ARG_START>;
+
+// Reads /proc/[pid]/stat, and /proc/[pid]/status if requested, into p.
+// Returns false if the process exited before it could be read.
+static bool readProcess(const ProcDir &proc, int pid, Proc &p, unsigned sources)
+{
+    static const long long pageKB = sysconf(_SC_PAGESIZE) / 1024;
+
+    char statLine[1024];
+    char status[4096];
+
+    ssize_t statLength = proc.readFile(pid, "stat", statLine, sizeof(statLine));
+    if (statLength <= 0)
+        return false;
+
+    p.pid = pid;
+
+    // Parse /proc/[pid]/stat
+    // Example: 1 (systemd) S 0 1 1 0 -1 4194304 1000 0 0 0 0 0 0 0 20 0 1 0 1 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+
+    // Read the process name, which can contain spaces and be enclosed in parentheses
+    const char *first_paren = strchr(statLine, '(');
+    const char *last_paren = strrchr(statLine, ')');
+    if (!first_paren || !last_paren || last_paren < first_paren || last_paren[1] != ' ')
+        return false;
+    p.name.assign(first_paren + 1, last_paren - (first_paren + 1));
+
+    // The fields after ') ' start at state (field 3)
+    long long values[ProcStatParser::count];
+    if (!ProcStatParser::parse(last_paren + 2, statLine + statLength, values))
+        return false;
+
+    p.state = (char)values[0];
+    p.ppid = (int)values[1];
+    p.pgrp = (int)values[2];
+    p.session = (int)values[3];
+    p.utime = values[4];
+    p.stime = values[5];
+    p.starttime = values[6];
+    p.vsize = values[7];
+    p.rss = values[8] * pageKB; // stat reports resident pages
+    long long argStart[1];
+    p.argStart = ProcArgParser::parse(last_paren + 2, statLine + statLength, argStart) ? argStart[0] : 0;
+    p.swap = 0;
+    p.cpuUsage = 0.0f;
+
+    // Only columns that need /proc/[pid]/status pay for opening it
+    ssize_t statusLength;
+    if ((sources & PROC_SOURCE_STATUS) && (statusLength = proc.readFile(pid, "status", status, sizeof(status))) > 0)
+        p.swap = findProcValue(status, status + statusLength, "VmSwap:");
+
+    return true;
+}
+
 // Function to get all running processes
 vector<Proc> getAllProcesses()
 {
     vector<Proc> processes;
-    DIR *dir;
-    struct dirent *ent;
+    getAllProcesses(processes);
+    return processes;
+}
 
-    if ((dir = opendir("/proc")) == NULL)
+// Fills processes with every running process, reusing its elements.
+// The PID list is split into chunks that are read concurrently on a worker
+// pool; each chunk writes its own slice of processes, so no locking is
+// needed, and slots of processes that exited mid-scan are compacted away.
+void getAllProcesses(vector<Proc> &processes, unsigned sources)
+{
+    static ProcDir proc;
+    static vector<int> pids;
+    static WorkerPool pool(min(max(thread::hardware_concurrency(), 1u) - 1, 15u));
+
+    if (!proc.listPids(pids))
     {
-        perror("opendir");
-        return processes;
+        processes.clear();
+        return;
     }
 
-    while ((ent = readdir(dir)) != NULL)
-    {
-        if (ent->d_type == DT_DIR)
+    // A few chunks per thread so a slow process doesn't leave the others idle
+    size_t chunkCount = min((pids.size() + PROCESS_SCAN_CHUNK - 1) / PROCESS_SCAN_CHUNK, (size_t)(pool.size() + 1) * 4);
+    chunkCount = max(chunkCount, (size_t)1);
+    processes.resize(pids.size());
+
+    pool.run(chunkCount, [&](size_t chunk) {
+        size_t begin = pids.size() * chunk / chunkCount;
+        size_t end = pids.size() * (chunk + 1) / chunkCount;
+        for (size_t i = begin; i < end; ++i)
         {
-            bool is_pid = true;
-            for (char *p = ent->d_name; *p; ++p)
-            {
-                if (!isdigit(*p))
-                {
-                    is_pid = false;
-                    break;
-                }
-            }
+            // The process may exit between the directory scan and this read
+            if (!readProcess(proc, pids[i], processes[i], sources))
+                processes[i].pid = -1;
+        }
+    });
 
-            if (is_pid)
-            {
-                int pid = stoi(ent->d_name);
-                string statPath = "/proc/" + string(ent->d_name) + "/stat";
-                string statusPath = "/proc/" + string(ent->d_name) + "/status";
-
-                ifstream statFile(statPath);
-                string statLine;
-                if (getline(statFile, statLine))
-                {
-                    Proc p;
-                    p.pid = pid;
-
-                    // Parse /proc/[pid]/stat
-                    // Example: 1 (systemd) S 0 1 1 0 -1 4194304 1000 0 0 0 0 0 0 0 20 0 1 0 1 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
-                    // char comm[256];
-                    char state_char;
-                    unsigned long vsize_ul, rss_ul, utime_ul, stime_ul, starttime_ul;
-
-                    // Read the process name, which can contain spaces and be enclosed in parentheses
-                    size_t first_paren = statLine.find('(');
-                    size_t last_paren = statLine.rfind(')');
-                    if (first_paren != string::npos && last_paren != string::npos && last_paren > first_paren) {
-                        p.name = statLine.substr(first_paren + 1, last_paren - (first_paren + 1));
-                    } else {
-                        p.name = "Unknown"; // Fallback if name parsing fails
-                    }
-
-                    // Extract the rest of the fields after the name
-                    string remaining_stat_line = statLine.substr(last_paren + 2); // +2 to skip ') '
-                    // Corrected sscanf to accurately parse fields from /proc/[pid]/stat
-                    // Fields needed: state, utime, stime, vsize, rss, starttime
-                    // The format string needs to account for all fields before the ones we need.
-                    // Based on proc(5) man page, fields are:
-                    // pid comm state ppid pgrp session tty_nr tpgid flags minflt cminflt majflt cmajflt utime stime cutime cstime priority nice num_threads rtpriority processor vsize rss starttime ...
-                    // We need to parse: state (field 3), utime (field 14), stime (field 15), vsize (field 23), rss (field 24), starttime (field 22)
-                    // The remaining_stat_line starts after 'comm' (field 2), so state is the 1st field in remaining_stat_line.
-                    // utime is the 12th field in remaining_stat_line.
-                    // stime is the 13th field in remaining_stat_line.
-                    // vsize is the 21st field in remaining_stat_line.
-                    // rss is the 22nd field in remaining_stat_line.
-                    // starttime is the 23rd field in remaining_stat_line.
-                    sscanf(remaining_stat_line.c_str(), "%c %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %lu %lu %*s %*s %*s %*s %*s %*s %*s %lu %lu %lu",
-                           &state_char, &utime_ul, &stime_ul, &vsize_ul, &rss_ul, &starttime_ul);
- 
-                    p.state = state_char;
-                    p.vsize = vsize_ul;
-                    p.rss = rss_ul;
-                    p.utime = utime_ul;
-                    p.stime = stime_ul;
-                    p.starttime = starttime_ul;
-
-                    // Get memory usage from /proc/[pid]/status (VmRSS)
-                    string vmRSS = getProcValue<string>(statusPath, "VmRSS:");
-                    if (!vmRSS.empty())
-                    {
-                        try
-                        {
-                            p.rss = stoll(vmRSS.substr(0, vmRSS.find(" "))); // Extract numeric part before "kB"
-                        }
-                        catch (...)
-                        {
-                            p.rss = 0;
-                        }
-                    }
-
-                    processes.push_back(p);
-                }
-                statFile.close();
-            }
+    processes.erase(remove_if(processes.begin(), processes.end(), [](const Proc &p) { return p.pid < 0; }),
+                    processes.end());
+}
+
+// Helper to calculate CPU usage for a process (matching 'top' algorithm)
+float calculateProcessCPUUsage(const Proc &p, const Proc &prev_p, const CPUStats &prev_cpu, const CPUStats &current_cpu)
+{
+    // Calculate process CPU time delta (in jiffies)
+    return calculateCPUTimeUsage((p.utime + p.stime) - (prev_p.utime + prev_p.stime), prev_cpu, current_cpu);
+}
+
+// CPU usage of a process or thread that ran processCPUTimeDelta jiffies
+// (utime + stime) while the system counters went from prev_cpu to current_cpu
+float calculateCPUTimeUsage(long long processCPUTimeDelta, const CPUStats &prev_cpu, const CPUStats &current_cpu)
+{
+    // Calculate total system CPU time delta (in jiffies)
+    long long totalSystemTimeDelta = (current_cpu.user - prev_cpu.user) +
+                                     (current_cpu.nice - prev_cpu.nice) +
+                                     (current_cpu.system - prev_cpu.system) +
+                                     (current_cpu.idle - prev_cpu.idle) +
+                                     (current_cpu.iowait - prev_cpu.iowait) +
+                                     (current_cpu.irq - prev_cpu.irq) +
+                                     (current_cpu.softirq - prev_cpu.softirq) +
+                                     (current_cpu.steal - prev_cpu.steal);
+
+    float cpuUsage = 0.0f;
+
+    // Calculate CPU usage percentage like 'top' does
+    if (totalSystemTimeDelta > 0 && processCPUTimeDelta >= 0) {
+        // Get number of CPU cores
+        static int numCores = 0;
+        if (numCores == 0) {
+            numCores = sysconf(_SC_NPROCESSORS_ONLN);
+            if (numCores <= 0) numCores = 1;
         }
+
+        // CPU usage = (process_cpu_time_delta / total_cpu_time_delta) * 100 * num_cores
+        // This matches the algorithm used by 'top' command more closely
+        cpuUsage = ((float)processCPUTimeDelta / (float)totalSystemTimeDelta) * 100.0f * numCores;
+
+        // Ensure we don't show negative values
+        cpuUsage = std::max(0.0f, cpuUsage);
     }
 
-    closedir(dir);
-    return processes;
+    return cpuUsage;
 }
 
 // Function to get detailed swap information matching 'free -h' output
 SwapInfo getDetailedSwapInfo()
 {
-    SwapInfo swapInfo = {};
-
     // Read from /proc/meminfo for accurate swap values
-    ifstream file("/proc/meminfo");
-    string line;
-    map<string, long long> memValues;
-
-    while (getline(file, line)) {
-        size_t colonPos = line.find(":");
-        if (colonPos != string::npos) {
-            string key = line.substr(0, colonPos);
-            string valueStr = line.substr(colonPos + 1);
-
-            // Remove whitespace and "kB" suffix
-            valueStr.erase(remove_if(valueStr.begin(), valueStr.end(), ::isspace), valueStr.end());
-            if (valueStr.find("kB") != string::npos) {
-                valueStr = valueStr.substr(0, valueStr.find("kB"));
-            }
+    return getDetailedSwapInfo(readMemInfo());
+}
 
-            try {
-                memValues[key] = stoll(valueStr);
-            } catch (...) {
-                // Ignore conversion errors
-            }
-        }
-    }
-    file.close();
+SwapInfo getDetailedSwapInfo(const MemInfoFields &fields)
+{
+    SwapInfo swapInfo = {};
 
     // Calculate values in GB (using 1024^2 for KB to GB conversion)
     const double GB_FACTOR = 1024.0 * 1024.0;
 
-    long long totalSwapKB = memValues["SwapTotal"];
-    long long freeSwapKB = memValues["SwapFree"];
+    long long totalSwapKB = fields.swapTotal;
+    long long freeSwapKB = fields.swapFree;
     long long usedSwapKB = totalSwapKB - freeSwapKB;
 
     swapInfo.totalGB = totalSwapKB / GB_FACTOR;
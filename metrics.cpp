@@ -0,0 +1,342 @@
+#include "collector.h"
+#include <algorithm> // For std::fill
+
+// Quantile histogram: bucket 0 holds everything <= STATS_MIN_VALUE (zero,
+// negatives), bucket b > 0 holds (MIN * GAMMA^(b-1), MIN * GAMMA^b].
+// 1200 buckets of 2% reach ~2e7, above any RPM, percentage or Celsius.
+static const float STATS_MIN_VALUE = 1e-3f;
+static const double STATS_GAMMA = 1.02;
+static const int STATS_BUCKETS = 1200;
+
+RollingStats::RollingStats() : sum(0.0), sumSquares(0.0), n(0), buckets(STATS_BUCKETS, 0)
+{
+}
+
+int RollingStats::bucketFor(float value)
+{
+    if (!(value > STATS_MIN_VALUE))
+        return 0;
+    int b = 1 + (int)(log((double)value / STATS_MIN_VALUE) / log(STATS_GAMMA));
+    return b < STATS_BUCKETS ? b : STATS_BUCKETS - 1;
+}
+
+void RollingStats::add(unsigned long long seq, float value)
+{
+    // A new sample retires every older one it dominates; they can never
+    // be the window's min/max again
+    while (!minQueue.empty() && minQueue.back().second >= value)
+        minQueue.pop_back();
+    minQueue.emplace_back(seq, value);
+    while (!maxQueue.empty() && maxQueue.back().second <= value)
+        maxQueue.pop_back();
+    maxQueue.emplace_back(seq, value);
+
+    sum += value;
+    sumSquares += (double)value * value;
+    n++;
+    buckets[bucketFor(value)]++;
+}
+
+void RollingStats::remove(unsigned long long seq, float value)
+{
+    if (n == 0)
+        return;
+    if (!minQueue.empty() && minQueue.front().first == seq)
+        minQueue.pop_front();
+    if (!maxQueue.empty() && maxQueue.front().first == seq)
+        maxQueue.pop_front();
+
+    sum -= value;
+    sumSquares -= (double)value * value;
+    n--;
+    buckets[bucketFor(value)]--;
+    // Keep rounding drift from accumulating across long runs
+    if (n == 0)
+        sum = sumSquares = 0.0;
+}
+
+void RollingStats::clear()
+{
+    minQueue.clear();
+    maxQueue.clear();
+    sum = sumSquares = 0.0;
+    n = 0;
+    fill(buckets.begin(), buckets.end(), 0);
+}
+
+float RollingStats::minimum() const
+{
+    return minQueue.empty() ? 0.0f : minQueue.front().second;
+}
+
+float RollingStats::maximum() const
+{
+    return maxQueue.empty() ? 0.0f : maxQueue.front().second;
+}
+
+float RollingStats::mean() const
+{
+    return n ? (float)(sum / n) : 0.0f;
+}
+
+float RollingStats::stddev() const
+{
+    if (n < 2)
+        return 0.0f;
+    double m = sum / n;
+    double variance = sumSquares / n - m * m;
+    return variance > 0.0 ? (float)sqrt(variance) : 0.0f;
+}
+
+float RollingStats::quantile(float q) const
+{
+    if (n == 0)
+        return 0.0f;
+    size_t rank = (size_t)(q * (n - 1));
+    size_t seen = 0;
+    int b = 0;
+    for (; b < STATS_BUCKETS; ++b)
+    {
+        seen += buckets[b];
+        if (seen > rank)
+            break;
+    }
+    // Bucket midpoint, then clamp: the extremes are known exactly
+    float value = b == 0 ? minimum() : (float)(STATS_MIN_VALUE * pow(STATS_GAMMA, b - 1) * (1.0 + STATS_GAMMA) / 2.0);
+    return fmin(fmax(value, minimum()), maximum());
+}
+
+MetricsStore::MetricsStore(size_t retention) : retention(retention ? retention : 1), count(0)
+{
+}
+
+MetricsStore::Series *MetricsStore::get(SeriesId id) const
+{
+    if (id < 0 || (size_t)id >= count.load(memory_order_acquire))
+        return nullptr;
+    return series[id].get();
+}
+
+SeriesId MetricsStore::addSeries()
+{
+    lock_guard<mutex> guard(addMutex);
+    size_t n = count.load(memory_order_relaxed);
+    if (n >= (size_t)MAX_SERIES)
+        return -1;
+    auto s = make_unique<Series>();
+    s->times.resize(retention);
+    s->values.resize(retention);
+    series[n] = move(s);
+    // Publishes the slot; readers check the count before touching it
+    count.store(n + 1, memory_order_release);
+    return (SeriesId)n;
+}
+
+void MetricsStore::append(SeriesId id, double timestamp, float value)
+{
+    Series *s = get(id);
+    if (!s)
+        return;
+    lock_guard<mutex> guard(s->lock);
+    size_t capacity = s->values.size();
+    // The slot about to be overwritten may still be inside the window
+    if (s->size == capacity && s->windowCount == capacity)
+    {
+        s->stats.remove(s->nextSeq - s->windowCount, s->values[s->head]);
+        s->windowCount--;
+    }
+    s->times[s->head] = timestamp;
+    s->values[s->head] = value;
+    s->head = s->head + 1 == capacity ? 0 : s->head + 1;
+    if (s->size < capacity)
+        s->size++;
+    s->version++;
+
+    s->stats.add(s->nextSeq++, value);
+    s->windowCount++;
+    evictOutsideWindow(*s, timestamp);
+}
+
+// Drops samples older than newest - window from the statistics
+void MetricsStore::evictOutsideWindow(Series &s, double newest)
+{
+    size_t capacity = s.values.size();
+    double cutoff = newest - s.window;
+    while (s.windowCount > 0)
+    {
+        size_t oldest = (s.head + capacity - s.windowCount) % capacity;
+        if (s.times[oldest] >= cutoff)
+            break;
+        s.stats.remove(s.nextSeq - s.windowCount, s.values[oldest]);
+        s.windowCount--;
+    }
+}
+
+// Refills the statistics from the ring, after the window or retention changed
+void MetricsStore::rebuildStats(Series &s)
+{
+    s.stats.clear();
+    s.windowCount = 0;
+    if (s.size == 0)
+        return;
+    size_t capacity = s.values.size();
+    double newest = s.times[(s.head + capacity - 1) % capacity];
+    // Samples are sorted, so the window is a suffix of the ring
+    size_t count = 0;
+    while (count < s.size && s.times[(s.head + capacity - count - 1) % capacity] >= newest - s.window)
+        count++;
+    for (size_t i = count; i > 0; --i)
+    {
+        size_t index = (s.head + capacity - i) % capacity;
+        s.stats.add(s.nextSeq - i, s.values[index]);
+    }
+    s.windowCount = count;
+}
+
+void MetricsStore::setWindow(SeriesId id, double seconds)
+{
+    Series *s = get(id);
+    if (!s || seconds <= 0.0)
+        return;
+    lock_guard<mutex> guard(s->lock);
+    if (s->window == seconds)
+        return;
+    s->window = seconds;
+    rebuildStats(*s);
+}
+
+WindowStats MetricsStore::stats(SeriesId id) const
+{
+    WindowStats result = {};
+    Series *s = get(id);
+    if (!s)
+        return result;
+    lock_guard<mutex> guard(s->lock);
+    const RollingStats &stats = s->stats;
+    result.count = stats.count();
+    result.min = stats.minimum();
+    result.max = stats.maximum();
+    result.mean = stats.mean();
+    result.stddev = stats.stddev();
+    result.p50 = stats.quantile(0.50f);
+    result.p95 = stats.quantile(0.95f);
+    result.p99 = stats.quantile(0.99f);
+    return result;
+}
+
+size_t MetricsStore::read(SeriesId id, double since, double until, vector<double> &times, vector<float> &values) const
+{
+    times.clear();
+    values.clear();
+    Series *s = get(id);
+    if (!s)
+        return 0;
+    lock_guard<mutex> guard(s->lock);
+    size_t capacity = s->values.size();
+    size_t oldest = (s->head + capacity - s->size) % capacity;
+
+    // Timestamps are sorted along the ring, so binary search both window ends
+    auto lowerBound = [&](double t, bool inclusive) {
+        size_t lo = 0, hi = s->size;
+        while (lo < hi)
+        {
+            size_t mid = (lo + hi) / 2;
+            double time = s->times[(oldest + mid) % capacity];
+            if (time < t || (!inclusive && time == t))
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return lo;
+    };
+    size_t first = lowerBound(since, true);
+    size_t last = lowerBound(until, false);
+    if (last <= first)
+        return 0;
+    size_t n = last - first;
+    size_t start = (oldest + first) % capacity;
+
+    // At most two contiguous runs: up to the end of the ring, then from 0
+    size_t run = min(n, capacity - start);
+    times.insert(times.end(), s->times.begin() + start, s->times.begin() + start + run);
+    values.insert(values.end(), s->values.begin() + start, s->values.begin() + start + run);
+    times.insert(times.end(), s->times.begin(), s->times.begin() + (n - run));
+    values.insert(values.end(), s->values.begin(), s->values.begin() + (n - run));
+    return n;
+}
+
+bool MetricsStore::last(SeriesId id, double &timestamp, float &value) const
+{
+    Series *s = get(id);
+    if (!s)
+        return false;
+    lock_guard<mutex> guard(s->lock);
+    if (s->size == 0)
+        return false;
+    size_t newest = (s->head + s->values.size() - 1) % s->values.size();
+    timestamp = s->times[newest];
+    value = s->values[newest];
+    return true;
+}
+
+unsigned long long MetricsStore::version(SeriesId id) const
+{
+    Series *s = get(id);
+    if (!s)
+        return 0;
+    lock_guard<mutex> guard(s->lock);
+    return s->version;
+}
+
+void downsampleLTTB(const vector<double> &x, const vector<float> &y, size_t threshold, vector<float> &out)
+{
+    size_t n = y.size();
+    out.clear();
+    if (threshold < 3 || n <= threshold)
+    {
+        out.assign(y.begin(), y.end());
+        return;
+    }
+    out.reserve(threshold);
+
+    // First and last points are kept; the rest is split into threshold - 2 buckets
+    double bucketSize = (double)(n - 2) / (double)(threshold - 2);
+    size_t a = 0;
+    out.push_back(y[0]);
+    for (size_t bucket = 0; bucket < threshold - 2; ++bucket)
+    {
+        size_t start = 1 + (size_t)(bucket * bucketSize);
+        size_t end = 1 + (size_t)((bucket + 1) * bucketSize);
+
+        // Average of the next bucket is the third triangle vertex
+        size_t nextStart = end;
+        size_t nextEnd = min(n, 1 + (size_t)((bucket + 2) * bucketSize));
+        if (nextEnd <= nextStart)
+            nextEnd = min(n, nextStart + 1);
+        double avgX = 0.0, avgY = 0.0;
+        for (size_t i = nextStart; i < nextEnd; ++i)
+        {
+            avgX += x[i];
+            avgY += y[i];
+        }
+        avgX /= (double)(nextEnd - nextStart);
+        avgY /= (double)(nextEnd - nextStart);
+
+        // Keep the point of this bucket spanning the largest triangle with
+        // the previously kept point and that average
+        double bestArea = -1.0;
+        size_t best = start;
+        for (size_t i = start; i < end; ++i)
+        {
+            double area = fabs((x[a] - avgX) * (y[i] - y[a]) - (x[a] - x[i]) * (avgY - y[a]));
+            if (area > bestArea)
+            {
+                bestArea = area;
+                best = i;
+            }
+        }
+        out.push_back(y[best]);
+        a = best;
+    }
+    out.push_back(y[n - 1]);
+}
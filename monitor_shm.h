@@ -0,0 +1,167 @@
+/*
+ * monitor_shm.h - layout of the snapshot the monitor publishes in POSIX
+ * shared memory (`monitor --shm` / `monitor-agent --shm`).
+ *
+ * Plain C (C99 + GCC/Clang __atomic builtins), no dependency on the rest of
+ * the monitor: copy this file into any tool that wants the numbers.
+ *
+ * The segment (default name MONITOR_SHM_NAME) holds one struct monitor_shm.
+ * It is guarded by a seqlock: the writer makes `seq` odd, updates the data,
+ * then makes it even again. Readers never block the writer and need no
+ * syscalls after the initial shm_open/mmap; they copy the data and retry if
+ * `seq` changed meanwhile (see monitor_shm_read below).
+ *
+ *     int fd = shm_open(MONITOR_SHM_NAME, O_RDONLY, 0);
+ *     const struct monitor_shm *shm =
+ *         mmap(NULL, sizeof(struct monitor_shm), PROT_READ, MAP_SHARED, fd, 0);
+ *     struct monitor_shm_data data;
+ *     if (shm->magic == MONITOR_SHM_MAGIC && shm->version == MONITOR_SHM_VERSION)
+ *         monitor_shm_read(shm, &data);
+ *
+ * All strings are NUL-terminated (truncated if needed). Byte counts are
+ * bytes; CPU and memory percentages are 0..100. Only the first *_count
+ * entries of each array are valid.
+ */
+#ifndef MONITOR_SHM_H
+#define MONITOR_SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MONITOR_SHM_NAME "/system-monitor"
+#define MONITOR_SHM_MAGIC 0x4d48534dU /* "MSHM" */
+#define MONITOR_SHM_VERSION 1U
+
+#define MONITOR_SHM_MAX_CPUS 512
+#define MONITOR_SHM_MAX_SENSORS 64
+#define MONITOR_SHM_MAX_INTERFACES 64
+#define MONITOR_SHM_MAX_PROCESSES 32768
+
+/* Index into monitor_shm_cpu.mode, in /proc/stat column order */
+enum monitor_shm_cpu_mode
+{
+    MONITOR_SHM_CPU_USER,
+    MONITOR_SHM_CPU_NICE,
+    MONITOR_SHM_CPU_SYSTEM,
+    MONITOR_SHM_CPU_IDLE,
+    MONITOR_SHM_CPU_IOWAIT,
+    MONITOR_SHM_CPU_IRQ,
+    MONITOR_SHM_CPU_SOFTIRQ,
+    MONITOR_SHM_CPU_STEAL,
+    MONITOR_SHM_CPU_GUEST,
+    MONITOR_SHM_CPU_GUEST_NICE,
+    MONITOR_SHM_CPU_MODES
+};
+
+enum monitor_shm_sensor_type
+{
+    MONITOR_SHM_SENSOR_FAN = 0,         /* RPM */
+    MONITOR_SHM_SENSOR_TEMPERATURE = 1, /* Celsius */
+};
+
+struct monitor_shm_cpu
+{
+    int32_t id;                         /* -1 for the all-CPU total */
+    float busy;                         /* 100 - idle - iowait */
+    float mode[MONITOR_SHM_CPU_MODES];  /* share of time per mode */
+};
+
+struct monitor_shm_sensor
+{
+    uint32_t type; /* enum monitor_shm_sensor_type */
+    float value;
+    char label[56];
+};
+
+struct monitor_shm_interface
+{
+    char name[32];
+    uint64_t rx_bytes, rx_packets, rx_errors, rx_drop;
+    uint64_t tx_bytes, tx_packets, tx_errors, tx_drop;
+};
+
+struct monitor_shm_process
+{
+    int32_t pid;
+    float cpu_percent;
+    uint64_t rss_bytes;
+    uint64_t vsize_bytes;
+    uint64_t swap_bytes; /* 0 unless the monitor reads /proc/[pid]/status */
+    char state;
+    char name[23];
+};
+
+/* Everything the seqlock protects */
+struct monitor_shm_data
+{
+    uint64_t sequence;  /* snapshot number, increases on every publish */
+    double timestamp;   /* seconds since the monitor started sampling */
+    double wall_time;   /* CLOCK_REALTIME seconds of the publish */
+
+    char hostname[64];
+    char os_name[64];
+    char cpu_type[128];
+
+    uint32_t total_processes;
+    float fan_speed;       /* RPM */
+    float cpu_temperature; /* Celsius */
+
+    uint64_t memory_total_bytes, memory_used_bytes, memory_free_bytes, memory_available_bytes;
+    uint64_t memory_buff_cache_bytes, memory_dirty_bytes, memory_writeback_bytes;
+    uint64_t memory_slab_bytes, memory_shmem_bytes, memory_anon_huge_pages_bytes;
+    float memory_percent;
+    float swap_percent;
+    uint64_t swap_total_bytes, swap_used_bytes, swap_free_bytes;
+    uint64_t disk_total_bytes, disk_used_bytes, disk_available_bytes;
+    float disk_percent;
+
+    uint32_t cpu_count;
+    uint32_t sensor_count;
+    uint32_t interface_count;
+    uint32_t process_count; /* may be less than total_processes if capped */
+
+    struct monitor_shm_cpu cpu_total;
+    struct monitor_shm_cpu cpus[MONITOR_SHM_MAX_CPUS];
+    struct monitor_shm_sensor sensors[MONITOR_SHM_MAX_SENSORS];
+    struct monitor_shm_interface interfaces[MONITOR_SHM_MAX_INTERFACES];
+    struct monitor_shm_process processes[MONITOR_SHM_MAX_PROCESSES];
+};
+
+struct monitor_shm
+{
+    uint32_t magic;   /* MONITOR_SHM_MAGIC once the writer set the segment up */
+    uint32_t version; /* MONITOR_SHM_VERSION */
+    uint32_t size;    /* sizeof(struct monitor_shm) of the writer */
+    uint32_t pid;     /* writer process */
+    uint64_t seq;     /* seqlock counter: odd while the data is being written */
+    uint64_t reserved[5];
+    struct monitor_shm_data data;
+};
+
+/*
+ * Copies a consistent snapshot into *out. Returns 0, or -1 if no snapshot
+ * was published yet. The process table alone can be large; copying only the
+ * first process_count entries keeps the read (and its retry window) short.
+ */
+static inline int monitor_shm_read(const struct monitor_shm *shm, struct monitor_shm_data *out)
+{
+    for (;;)
+    {
+        uint64_t begin = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+        if (begin & 1)
+            continue; /* writer in progress */
+        if (begin == 0)
+            return -1;
+        memcpy(out, &shm->data, offsetof(struct monitor_shm_data, processes));
+        uint32_t count = out->process_count;
+        if (count > MONITOR_SHM_MAX_PROCESSES)
+            count = MONITOR_SHM_MAX_PROCESSES;
+        memcpy(out->processes, shm->data.processes, count * sizeof(struct monitor_shm_process));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) == begin)
+            return 0;
+    }
+}
+
+#endif /* MONITOR_SHM_H */
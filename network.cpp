@@ -1,4 +1,4 @@
-#include "header.h"
+#include "collector.h"
 #include <fstream>
 #include <sstream>
 #include <map>
@@ -6,6 +6,40 @@
 // Convert bytes to appropriate unit
 #include <chrono>
 
+// /proc/net/dev is kept open between scans
+static ProcFile proc_net_dev("/proc/net/dev");
+
+// Calls fn(interface, counters) for every interface line of /proc/net/dev,
+// where counters holds the 8 RX fields followed by the 8 TX fields
+template <typename Fn>
+static void forEachNetDevLine(Fn fn)
+{
+    size_t length;
+    const char *line = proc_net_dev.read(&length);
+    if (!line)
+        return;
+    const char *end = line + length;
+
+    // Skip header lines
+    line = findNthByte(line, end, '\n', 2);
+
+    while (line < end) {
+        line++;
+        const char *eol = findNthByte(line, end, '\n', 1);
+        const char *colon = (const char *)memchr(line, ':', eol - line);
+        if (!colon)
+            break;
+        // Trim whitespace from interface name
+        const char *name = line;
+        while (name < colon && (*name == ' ' || *name == '\t'))
+            name++;
+        unsigned long long counters[16] = {};
+        parseUnsignedRun(colon + 1, eol, counters, 16);
+        fn(string(name, colon - name), counters);
+        line = eol;
+    }
+}
+
 string formatBytes(long long bytes) {
     double converted = bytes;
     const char* units[] = {"B", "KB", "MB", "GB"};
@@ -30,7 +64,7 @@ vector<IP4> getIPv4Addresses() {
     for (ifa = ifaddr; ifa != nullptr; ifa = ifa->ifa_next) {
         if (ifa->ifa_addr && ifa->ifa_addr->sa_family == AF_INET) {
             IP4 ip;
-            ip.name = ifa->ifa_name;
+            snprintf(ip.name, sizeof(ip.name), "%s", ifa->ifa_name);
             void *addr = &((struct sockaddr_in *)ifa->ifa_addr)->sin_addr;
             inet_ntop(AF_INET, addr, ip.addressBuffer, INET_ADDRSTRLEN);
             ip4s.push_back(ip);
@@ -40,65 +74,35 @@ vector<IP4> getIPv4Addresses() {
     return ip4s;
 }
 
-// Get RX (receive) statistics for all network interfaces
-map<string, RX> getRXStats() {
-    map<string, RX> rxStats;
-    ifstream netdev("/proc/net/dev");
-    string line;
-
-    // Skip header lines
-    getline(netdev, line); // Inter-|   Receive...
-    getline(netdev, line); // face  |   bytes....
-
-    while (getline(netdev, line)) {
-        istringstream iss(line);
-        string interface;
-        getline(iss, interface, ':');
-        // Trim whitespace from interface name
-        interface.erase(0, interface.find_first_not_of(" \t"));
-        interface.erase(interface.find_last_not_of(" \t") + 1);
-
+// Get RX (receive) and TX (transmit) statistics for all network interfaces
+// from one read of /proc/net/dev
+void getNetStats(map<string, RX> &rxStats, map<string, TX> &txStats) {
+    rxStats.clear();
+    txStats.clear();
+    forEachNetDevLine([&](const string &interface, const unsigned long long *counters) {
         RX rx;
-        iss >> rx.bytes >> rx.packets >> rx.errs >> rx.drop
-            >> rx.fifo >> rx.colls >> rx.carrier >> rx.compressed;
-        
+        rx.bytes = counters[0];
+        rx.packets = counters[1];
+        rx.errs = counters[2];
+        rx.drop = counters[3];
+        rx.fifo = counters[4];
+        rx.colls = counters[5];
+        rx.carrier = counters[6];
+        rx.compressed = counters[7];
         rxStats[interface] = rx;
-    }
-    return rxStats;
-}
-
-// Get TX (transmit) statistics for all network interfaces
-map<string, TX> getTXStats() {
-    map<string, TX> txStats;
-    ifstream netdev("/proc/net/dev");
-    string line;
-
-    // Skip header lines
-    getline(netdev, line);
-    getline(netdev, line);
-
-    while (getline(netdev, line)) {
-        istringstream iss(line);
-        string interface;
-        getline(iss, interface, ':');
-        // Trim whitespace from interface name
-        interface.erase(0, interface.find_first_not_of(" \t"));
-        interface.erase(interface.find_last_not_of(" \t") + 1);
-
-        // Skip RX stats
-        // Skip RX stats (8 fields)
-        string dummy;
-        for (int i = 0; i < 8; ++i) {
-            iss >> dummy;
-        }
 
+        // TX follows the 8 RX fields
         TX tx;
-        iss >> tx.bytes >> tx.packets >> tx.errs >> tx.drop
-            >> tx.fifo >> tx.frame >> tx.compressed >> tx.multicast;
-        
+        tx.bytes = counters[8];
+        tx.packets = counters[9];
+        tx.errs = counters[10];
+        tx.drop = counters[11];
+        tx.fifo = counters[12];
+        tx.frame = counters[13];
+        tx.compressed = counters[14];
+        tx.multicast = counters[15];
         txStats[interface] = tx;
-    }
-    return txStats;
+    });
 }
 
 
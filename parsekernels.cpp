@@ -0,0 +1,302 @@
+#include "collector.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PARSE_KERNELS_X86 1
+#endif
+
+// Parsing kernels for /proc text: delimiter search and decimal decoding.
+// The x86 builds carry SSE4.2 and AVX2 variants compiled with per-function
+// target attributes; the variant is chosen once at startup from cpuid, the
+// same instruction CPUinfo() uses, so the binary still runs on any x86-64.
+
+// Decodes the digits in [s, s + length) into an integer. Runs of up to 8
+// digits are converted together (SWAR) when 8 bytes are readable at s.
+static inline unsigned long long decodeDigits(const char *s, size_t length, const char *end)
+{
+    unsigned long long value = 0;
+    while (length > 0)
+    {
+        size_t chunk = length % 8 ? length % 8 : 8;
+        if (s + 8 <= end)
+        {
+            unsigned long long v;
+            memcpy(&v, s, 8);
+            // Keep the chunk's digits, right-aligned as if padded with leading zeros
+            v = (v & 0x0F0F0F0F0F0F0F0Full) << (8 * (8 - chunk));
+            v = (v * 2561) >> 8;
+            v = ((v & 0x00FF00FF00FF00FFull) * 6553601) >> 16;
+            v = ((v & 0x0000FFFF0000FFFFull) * 42949672960001ull) >> 32;
+            static const unsigned long long scale[9] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+            value = value * scale[chunk] + v;
+        }
+        else
+        {
+            for (size_t i = 0; i < chunk; ++i)
+                value = value * 10 + (s[i] - '0');
+        }
+        s += chunk;
+        length -= chunk;
+    }
+    return value;
+}
+
+static inline bool isDigit(char c)
+{
+    return (unsigned char)(c - '0') <= 9;
+}
+
+// ---------------------------------------------------------------------------
+// Scalar kernels
+// ---------------------------------------------------------------------------
+
+static const char *findNthByteScalar(const char *p, const char *end, char c, size_t n)
+{
+    for (; p < end; ++p)
+    {
+        if (*p == c && --n == 0)
+            return p;
+    }
+    return end;
+}
+
+static size_t parseUnsignedRunScalar(const char *p, const char *end, unsigned long long *out, size_t max, const char **next)
+{
+    size_t count = 0;
+    while (p < end && count < max)
+    {
+        if (isDigit(*p))
+        {
+            const char *start = p;
+            while (p < end && isDigit(*p))
+                p++;
+            out[count++] = decodeDigits(start, p - start, end);
+        }
+        else if (*p == '\n')
+        {
+            break;
+        }
+        else
+        {
+            p++;
+        }
+    }
+    if (next)
+        *next = p;
+    return count;
+}
+
+// ---------------------------------------------------------------------------
+// SIMD kernels. Both widths share one body: a block is classified into a
+// digit mask and a delimiter mask, and the bit scans below walk the runs.
+// ---------------------------------------------------------------------------
+
+#ifdef PARSE_KERNELS_X86
+
+enum BlockResult
+{
+    BLOCK_DONE,  // every run in the block was consumed
+    BLOCK_STOP,  // hit a newline or decoded max values
+    BLOCK_SPLIT, // a number starts at pos and continues past the block
+};
+
+// Walks one classified block from bit pos, decoding every digit run that
+// ends inside the block.
+static inline BlockResult walkBlock(const char *block, const char *end, unsigned width, unsigned digits, unsigned newlines,
+                             unsigned &pos, unsigned long long *out, size_t &count, size_t max)
+{
+    unsigned long long full = width == 32 ? 0xFFFFFFFFull : 0xFFFFull;
+    while (pos < width && count < max)
+    {
+        unsigned long long fromPos = (full << pos) & full;
+        unsigned long long next = (digits | newlines) & fromPos;
+        if (!next)
+        {
+            pos = width;
+            return BLOCK_DONE;
+        }
+        unsigned start = __builtin_ctzll(next);
+        if (newlines & (1u << start))
+        {
+            pos = start;
+            return BLOCK_STOP;
+        }
+        unsigned long long nonDigits = ~(unsigned long long)digits & ((full << start) & full);
+        if (!nonDigits)
+        {
+            pos = start;
+            return BLOCK_SPLIT;
+        }
+        unsigned stop = __builtin_ctzll(nonDigits);
+        out[count++] = decodeDigits(block + start, stop - start, end);
+        pos = stop;
+    }
+    return count < max ? BLOCK_DONE : BLOCK_STOP;
+}
+
+// Decodes the number at p that walkBlock() left split across blocks
+static inline const char *finishSplitNumber(const char *p, const char *end, unsigned long long *out, size_t &count)
+{
+    const char *start = p;
+    while (p < end && isDigit(*p))
+        p++;
+    out[count++] = decodeDigits(start, p - start, end);
+    return p;
+}
+
+__attribute__((target("sse4.2,popcnt"))) static const char *findNthByteSse42(const char *p, const char *end, char c, size_t n)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    while (p + 16 <= end)
+    {
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), needle));
+        size_t hits = _mm_popcnt_u32(mask);
+        if (hits >= n)
+        {
+            while (--n)
+                mask &= mask - 1;
+            return p + __builtin_ctz(mask);
+        }
+        n -= hits;
+        p += 16;
+    }
+    return findNthByteScalar(p, end, c, n);
+}
+
+__attribute__((target("avx2,popcnt"))) static const char *findNthByteAvx2(const char *p, const char *end, char c, size_t n)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    while (p + 32 <= end)
+    {
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), needle));
+        size_t hits = _mm_popcnt_u32(mask);
+        if (hits >= n)
+        {
+            while (--n)
+                mask &= mask - 1;
+            return p + __builtin_ctz(mask);
+        }
+        n -= hits;
+        p += 32;
+    }
+    return findNthByteScalar(p, end, c, n);
+}
+
+__attribute__((target("sse4.2,popcnt"))) static size_t parseUnsignedRunSse42(const char *p, const char *end, unsigned long long *out, size_t max, const char **next)
+{
+    const __m128i zero = _mm_set1_epi8('0' - 1);
+    const __m128i nine = _mm_set1_epi8('9' + 1);
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t count = 0;
+    while (p + 16 <= end && count < max)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)p);
+        // Signed compares are fine: /proc text is ASCII
+        __m128i isDigitMask = _mm_and_si128(_mm_cmpgt_epi8(block, zero), _mm_cmplt_epi8(block, nine));
+        unsigned digits = _mm_movemask_epi8(isDigitMask);
+        unsigned newlines = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+        unsigned pos = 0;
+        BlockResult result = walkBlock(p, end, 16, digits, newlines, pos, out, count, max);
+        p += pos;
+        if (result == BLOCK_STOP)
+            break;
+        if (result == BLOCK_SPLIT)
+            p = finishSplitNumber(p, end, out, count);
+    }
+    const char *rest;
+    count += parseUnsignedRunScalar(p, end, out + count, max - count, &rest);
+    if (next)
+        *next = rest;
+    return count;
+}
+
+__attribute__((target("avx2,popcnt"))) static size_t parseUnsignedRunAvx2(const char *p, const char *end, unsigned long long *out, size_t max, const char **next)
+{
+    const __m256i zero = _mm256_set1_epi8('0' - 1);
+    const __m256i nine = _mm256_set1_epi8('9' + 1);
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t count = 0;
+    while (p + 32 <= end && count < max)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i *)p);
+        __m256i isDigitMask = _mm256_and_si256(_mm256_cmpgt_epi8(block, zero), _mm256_cmpgt_epi8(nine, block));
+        unsigned digits = (unsigned)_mm256_movemask_epi8(isDigitMask);
+        unsigned newlines = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline));
+        unsigned pos = 0;
+        BlockResult result = walkBlock(p, end, 32, digits, newlines, pos, out, count, max);
+        p += pos;
+        if (result == BLOCK_STOP)
+            break;
+        if (result == BLOCK_SPLIT)
+            p = finishSplitNumber(p, end, out, count);
+    }
+    const char *rest;
+    count += parseUnsignedRunScalar(p, end, out + count, max - count, &rest);
+    if (next)
+        *next = rest;
+    return count;
+}
+
+#endif // PARSE_KERNELS_X86
+
+// ---------------------------------------------------------------------------
+// Runtime dispatch
+// ---------------------------------------------------------------------------
+
+struct ParseKernels
+{
+    const char *(*findNthByte)(const char *, const char *, char, size_t);
+    size_t (*parseUnsignedRun)(const char *, const char *, unsigned long long *, size_t, const char **);
+    const char *name;
+};
+
+static ParseKernels selectParseKernels()
+{
+#ifdef PARSE_KERNELS_X86
+    unsigned int eax, ebx, ecx, edx;
+    bool sse42 = false, avx2 = false;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    {
+        sse42 = (ecx & bit_SSE4_2) && (ecx & bit_POPCNT);
+        // AVX state must also be enabled by the OS (OSXSAVE + XCR0)
+        bool osAvx = (ecx & bit_OSXSAVE) && (ecx & bit_AVX);
+        if (osAvx)
+        {
+            unsigned int xcr0Low, xcr0High;
+            __asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+            osAvx = (xcr0Low & 6) == 6;
+        }
+        if (osAvx && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+            avx2 = (ebx & bit_AVX2) != 0;
+    }
+    if (avx2 && sse42)
+        return {findNthByteAvx2, parseUnsignedRunAvx2, "avx2"};
+    if (sse42)
+        return {findNthByteSse42, parseUnsignedRunSse42, "sse4.2"};
+#endif
+    return {findNthByteScalar, parseUnsignedRunScalar, "scalar"};
+}
+
+// Selected on first use, so collectors running during static init are safe too
+static const ParseKernels &parseKernels()
+{
+    static const ParseKernels kernels = selectParseKernels();
+    return kernels;
+}
+
+const char *findNthByte(const char *p, const char *end, char c, size_t n)
+{
+    if (n == 0)
+        return p;
+    return parseKernels().findNthByte(p, end, c, n);
+}
+
+size_t parseUnsignedRun(const char *p, const char *end, unsigned long long *out, size_t max, const char **next)
+{
+    return parseKernels().parseUnsignedRun(p, end, out, max, next);
+}
+
+const char *parseKernelName()
+{
+    return parseKernels().name;
+}
@@ -0,0 +1,123 @@
+#include "collector.h"
+
+// Smallest table; grows by doubling so the load stays under 3/4
+static const size_t PROCESS_TABLE_MIN_CAPACITY = 1024;
+
+static inline size_t hashProcess(int pid, long long starttime)
+{
+    unsigned long long h = (unsigned long long)(unsigned)pid * 0x9E3779B97F4A7C15ull;
+    h ^= (unsigned long long)starttime + 0x632BE59BD9B4E019ull + (h << 6) + (h >> 2);
+    return (size_t)(h ^ (h >> 29));
+}
+
+ProcessTable::ProcessTable()
+    : used(0), deleted(0), generation(0), prevCpuStats(), hasPrevCpuStats(false)
+{
+    rehash(PROCESS_TABLE_MIN_CAPACITY);
+}
+
+// Linear probe for pid+starttime; returns the slot holding it or
+// entries.size() if the process isn't in the table
+size_t ProcessTable::slotFor(int pid, long long starttime) const
+{
+    size_t mask = entries.size() - 1;
+    for (size_t i = hashProcess(pid, starttime) & mask;; i = (i + 1) & mask)
+    {
+        if (states[i] == SLOT_EMPTY)
+            return entries.size();
+        if (states[i] == SLOT_USED && entries[i].proc.pid == pid && entries[i].proc.starttime == starttime)
+            return i;
+    }
+}
+
+const ProcessEntry *ProcessTable::find(int pid, long long starttime) const
+{
+    size_t slot = slotFor(pid, starttime);
+    return slot < entries.size() ? &entries[slot] : nullptr;
+}
+
+// Inserts a process known not to be in the table. Deleted slots are
+// reused, so their name storage is too.
+size_t ProcessTable::insert(const Proc &p)
+{
+    if ((used + deleted + 1) * 4 > entries.size() * 3)
+        rehash(max(PROCESS_TABLE_MIN_CAPACITY, entries.size() * (used * 2 > entries.size() ? 2 : 1)));
+
+    size_t mask = entries.size() - 1;
+    size_t i = hashProcess(p.pid, p.starttime) & mask;
+    while (states[i] == SLOT_USED)
+        i = (i + 1) & mask;
+
+    if (states[i] == SLOT_DELETED)
+        deleted--;
+    states[i] = SLOT_USED;
+    used++;
+    entries[i].proc = p;
+    return i;
+}
+
+// Rebuilds the table at the given capacity (a power of two), dropping tombstones
+void ProcessTable::rehash(size_t capacity)
+{
+    vector<ProcessEntry> oldEntries(capacity);
+    vector<SlotState> oldStates(capacity, SLOT_EMPTY);
+    oldEntries.swap(entries);
+    oldStates.swap(states);
+    used = 0;
+    deleted = 0;
+
+    size_t mask = capacity - 1;
+    for (size_t j = 0; j < oldEntries.size(); ++j)
+    {
+        if (oldStates[j] != SLOT_USED)
+            continue;
+        size_t i = hashProcess(oldEntries[j].proc.pid, oldEntries[j].proc.starttime) & mask;
+        while (states[i] == SLOT_USED)
+            i = (i + 1) & mask;
+        states[i] = SLOT_USED;
+        entries[i] = move(oldEntries[j]);
+        used++;
+    }
+}
+
+void ProcessTable::update(vector<Proc> &scan, const CPUStats &cpuStats)
+{
+    generation++;
+    started.clear();
+    exited.clear();
+
+    for (Proc &p : scan)
+    {
+        size_t slot = slotFor(p.pid, p.starttime);
+        if (slot == entries.size())
+        {
+            // New process: no previous sample to compute CPU usage against
+            p.cpuUsage = 0.0f;
+            slot = insert(p);
+            started.push_back(p.pid);
+        }
+        else
+        {
+            Proc &prev = entries[slot].proc;
+            p.cpuUsage = hasPrevCpuStats ? calculateProcessCPUUsage(p, prev, prevCpuStats, cpuStats) : 0.0f;
+            // Copy-assignment keeps the existing name buffer
+            prev = p;
+        }
+        entries[slot].seen = generation;
+    }
+
+    // Evict everything the scan didn't see
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        if (states[i] == SLOT_USED && entries[i].seen != generation)
+        {
+            exited.push_back(entries[i].proc.pid);
+            states[i] = SLOT_DELETED;
+            used--;
+            deleted++;
+        }
+    }
+
+    prevCpuStats = cpuStats;
+    hasPrevCpuStats = true;
+}
@@ -0,0 +1,209 @@
+#include "collector.h"
+
+ProcessTree::ProcessTree()
+{
+    // Node 0 is the root every top-level process hangs off (pid 0 is the
+    // parent the kernel reports for init and kthreadd)
+    Node root = {};
+    root.parent = root.firstChild = root.nextSibling = root.prevSibling = root.index = -1;
+    root.live = true;
+    nodes.push_back(root);
+}
+
+int ProcessTree::allocate(int pid)
+{
+    int id;
+    if (!freeNodes.empty())
+    {
+        id = freeNodes.back();
+        freeNodes.pop_back();
+    }
+    else
+    {
+        id = (int)nodes.size();
+        nodes.emplace_back();
+    }
+    Node &node = nodes[id];
+    node = Node();
+    node.pid = pid;
+    node.ppid = -1;
+    node.parent = node.firstChild = node.nextSibling = node.prevSibling = node.index = -1;
+    node.live = true;
+    node.subtreeCount = 1;
+    byPid[pid] = id;
+    return id;
+}
+
+// Makes id the first child of parent. A parent that is id itself or one of
+// its descendants (a pid reused mid-scan) would make a cycle: use the root.
+void ProcessTree::link(int id, int parent)
+{
+    for (int up = parent; up != -1; up = nodes[up].parent)
+    {
+        if (up == id)
+        {
+            parent = ROOT;
+            break;
+        }
+    }
+    Node &node = nodes[id];
+    node.parent = parent;
+    node.prevSibling = -1;
+    node.nextSibling = nodes[parent].firstChild;
+    if (node.nextSibling != -1)
+        nodes[node.nextSibling].prevSibling = id;
+    nodes[parent].firstChild = id;
+    markDirty(parent);
+}
+
+void ProcessTree::unlink(int id)
+{
+    Node &node = nodes[id];
+    if (node.parent == -1)
+        return;
+    if (node.prevSibling != -1)
+        nodes[node.prevSibling].nextSibling = node.nextSibling;
+    else
+        nodes[node.parent].firstChild = node.nextSibling;
+    if (node.nextSibling != -1)
+        nodes[node.nextSibling].prevSibling = node.prevSibling;
+    markDirty(node.parent);
+    node.parent = node.prevSibling = node.nextSibling = -1;
+}
+
+// Flags id and its ancestors for recompute(); stops at the first ancestor
+// already flagged, since everything above it is too
+void ProcessTree::markDirty(int id)
+{
+    while (id != -1 && !nodes[id].dirty)
+    {
+        nodes[id].dirty = true;
+        id = nodes[id].parent;
+    }
+}
+
+void ProcessTree::update(const vector<Proc> &processes, const vector<int> &started, const vector<int> &exited)
+{
+    for (int pid : exited)
+    {
+        auto it = byPid.find(pid);
+        if (it == byPid.end())
+            continue;
+        int id = it->second;
+        unlink(id);
+        // Orphans move to the root until the scan shows who adopted them
+        while (nodes[id].firstChild != -1)
+        {
+            int child = nodes[id].firstChild;
+            unlink(child);
+            link(child, ROOT);
+        }
+        nodes[id].live = false;
+        nodes[id].dirty = false;
+        freeNodes.push_back(id);
+        byPid.erase(it);
+    }
+
+    // All started processes exist before any is linked, so a child listed
+    // before its parent still finds it
+    for (int pid : started)
+    {
+        if (!byPid.count(pid))
+            allocate(pid);
+    }
+
+    for (size_t i = 0; i < processes.size(); ++i)
+    {
+        const Proc &p = processes[i];
+        auto it = byPid.find(p.pid);
+        int id = it != byPid.end() ? it->second : allocate(p.pid);
+        Node &node = nodes[id];
+        node.index = (int)i;
+
+        // Relink only new processes and ones whose parent changed
+        if (node.parent == -1 || node.ppid != p.ppid)
+        {
+            auto parent = byPid.find(p.ppid);
+            int parentId = parent != byPid.end() && parent->second != id ? parent->second : ROOT;
+            node.ppid = p.ppid;
+            if (nodes[id].parent != parentId)
+            {
+                unlink(id);
+                link(id, parentId);
+            }
+        }
+        // An orphan parked at the root whose parent has since appeared
+        else if (node.parent == ROOT && p.ppid > 0 && byPid.count(p.ppid))
+        {
+            unlink(id);
+            link(id, byPid[p.ppid]);
+        }
+
+        if (nodes[id].cpu != p.cpuUsage || nodes[id].rss != p.rss)
+        {
+            nodes[id].cpu = p.cpuUsage;
+            nodes[id].rss = p.rss;
+            markDirty(id);
+        }
+    }
+
+    recompute();
+}
+
+// Post-order over the flagged nodes only: a clean child's totals are reused
+void ProcessTree::recompute()
+{
+    if (!nodes[ROOT].dirty)
+        return;
+    stack.clear();
+    stack.emplace_back(ROOT, false);
+    while (!stack.empty())
+    {
+        int id = stack.back().first;
+        if (!stack.back().second)
+        {
+            stack.back().second = true;
+            for (int child = nodes[id].firstChild; child != -1; child = nodes[child].nextSibling)
+            {
+                if (nodes[child].dirty)
+                    stack.emplace_back(child, false);
+            }
+            continue;
+        }
+        stack.pop_back();
+
+        Node &node = nodes[id];
+        node.subtreeCpu = node.cpu;
+        node.subtreeRss = node.rss;
+        node.subtreeCount = 1;
+        for (int child = node.firstChild; child != -1; child = nodes[child].nextSibling)
+        {
+            node.subtreeCpu += nodes[child].subtreeCpu;
+            node.subtreeRss += nodes[child].subtreeRss;
+            node.subtreeCount += nodes[child].subtreeCount;
+        }
+        node.dirty = false;
+    }
+}
+
+void ProcessTree::publish(ProcessSnapshot &out) const
+{
+    out.tree.assign(out.processes.size(), ProcessTreeNode{-1, -1, -1, 0, 0.0f, 0});
+    out.treeRoots.clear();
+    auto indexOf = [this](int id) { return id == -1 || id == ROOT ? -1 : nodes[id].index; };
+    for (size_t id = 1; id < nodes.size(); ++id)
+    {
+        const Node &node = nodes[id];
+        if (!node.live || node.index < 0 || node.index >= (int)out.tree.size())
+            continue;
+        ProcessTreeNode &t = out.tree[node.index];
+        t.parent = indexOf(node.parent);
+        t.firstChild = indexOf(node.firstChild);
+        t.nextSibling = indexOf(node.nextSibling);
+        t.descendants = node.subtreeCount - 1;
+        t.subtreeCpu = node.subtreeCpu;
+        t.subtreeRss = node.subtreeRss;
+    }
+    for (int child = nodes[ROOT].firstChild; child != -1; child = nodes[child].nextSibling)
+        out.treeRoots.push_back(nodes[child].index);
+}
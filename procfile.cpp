@@ -0,0 +1,174 @@
+#include "collector.h"
+#include <cerrno> // For errno
+#include <sys/syscall.h> // For SYS_getdents64
+
+// Initial buffer size; enough for /proc/meminfo, /proc/net/dev and most of /proc/stat
+static const size_t PROC_FILE_INITIAL_SIZE = 4096;
+
+ProcFile::ProcFile(const char *path) : path(path), fd(-1), buffer(PROC_FILE_INITIAL_SIZE)
+{
+    open();
+}
+
+ProcFile::~ProcFile()
+{
+    if (fd >= 0)
+        close(fd);
+}
+
+bool ProcFile::open()
+{
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    return fd >= 0;
+}
+
+const char *ProcFile::read(size_t *length)
+{
+    // Files that were missing at startup (e.g. a sensor driver loaded later) get retried
+    if (fd < 0 && !open())
+        return nullptr;
+
+    size_t total = 0;
+    for (;;)
+    {
+        size_t space = buffer.size() - 1 - total;
+        ssize_t n = pread(fd, buffer.data() + total, space, total);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            // Only a file that went away (its device was removed) is reopened;
+            // a sensor failing a read (EIO, ENODATA) keeps its fd
+            if (errno == ENOENT || errno == ESTALE || errno == ENODEV)
+            {
+                close(fd);
+                fd = -1;
+            }
+            return nullptr;
+        }
+        total += n;
+        // A short read means we reached the end of the file
+        if ((size_t)n < space)
+            break;
+        buffer.resize(buffer.size() * 2);
+    }
+
+    buffer[total] = '\0';
+    if (length)
+        *length = total;
+    return buffer.data();
+}
+
+// getdents64 buffer; 256 KiB holds roughly 10k /proc entries per syscall
+static const size_t PROC_DIR_BUFFER_SIZE = 256 * 1024;
+
+// Record layout returned by the getdents64 syscall
+struct linux_dirent64
+{
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+ProcDir::ProcDir() : ProcDir("/proc")
+{
+    if (dirfd < 0)
+        perror("open /proc");
+}
+
+ProcDir::ProcDir(const char *path) : dirfd(-1), dents(PROC_DIR_BUFFER_SIZE)
+{
+    dirfd = ::open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+ProcDir::~ProcDir()
+{
+    if (dirfd >= 0)
+        close(dirfd);
+}
+
+bool ProcDir::listPids(vector<int> &pids)
+{
+    pids.clear();
+    if (dirfd < 0 || lseek(dirfd, 0, SEEK_SET) < 0)
+        return false;
+
+    for (;;)
+    {
+        long n = syscall(SYS_getdents64, dirfd, dents.data(), dents.size());
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            // A task directory whose process exited reads as ENOENT
+            if (errno != ENOENT)
+                perror("getdents64");
+            return false;
+        }
+        if (n == 0)
+            break;
+
+        for (long pos = 0; pos < n;)
+        {
+            const linux_dirent64 *ent = (const linux_dirent64 *)(dents.data() + pos);
+            pos += ent->d_reclen;
+
+            // PID directories are all digits; every other /proc entry starts with a
+            // non-digit, so accumulate and only check the terminator at the end
+            const unsigned char *c = (const unsigned char *)ent->d_name;
+            unsigned digit = *c - '0';
+            if (ent->d_type != DT_DIR || digit > 9)
+                continue;
+            int pid = 0;
+            while ((digit = *c - '0') <= 9)
+            {
+                pid = pid * 10 + digit;
+                c++;
+            }
+            if (*c == '\0')
+                pids.push_back(pid);
+        }
+    }
+    return true;
+}
+
+ssize_t ProcDir::readFile(int pid, const char *file, char *buf, size_t size) const
+{
+    // Build "<pid>/<file>" on the stack, relative to the /proc fd
+    char path[64];
+    char digits[16];
+    int len = 0;
+    int n = 0;
+    unsigned value = (unsigned)pid;
+    do
+    {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    while (n)
+        path[len++] = digits[--n];
+    path[len++] = '/';
+    for (const char *f = file; *f && len < (int)sizeof(path) - 1; ++f)
+        path[len++] = *f;
+    path[len] = '\0';
+
+    int fd = openat(dirfd, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    size_t total = 0;
+    while (total < size - 1)
+    {
+        ssize_t r = ::read(fd, buf + total, size - 1 - total);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            break;
+        total += r;
+    }
+    close(fd);
+    buf[total] = '\0';
+    return total;
+}
@@ -0,0 +1,320 @@
+#include "collector.h"
+#include <cerrno>     // For errno
+#include <sys/mman.h> // For mmap
+#include <sys/stat.h> // For fstat
+
+// A recording is two append-only files:
+//   PATH      the binary snapshot stream (serializeBinaryHeader, then one
+//             serializeSnapshot record per sample)
+//   PATH.idx  a small header, then one fixed-size RecordingIndexEntry per
+//             record, so the index can be mmapped and binary-searched and
+//             the plot values read without touching the records
+// Records are written before their index entry; a crash leaves at most an
+// unindexed record or a partial entry, both of which readers ignore.
+
+static const uint32_t RECORDING_INDEX_MAGIC = 0x58494d53; // "SMIX"
+static const uint32_t RECORDING_INDEX_VERSION = 1;
+
+struct RecordingIndexHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entrySize;
+    uint32_t reserved;
+};
+
+static string indexPath(const string &path)
+{
+    return path + ".idx";
+}
+
+// Writes all of data, retrying short writes
+static bool writeAll(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t n = write(fd, data, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+static double wallClock()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// ---------------------------------------------------------------------------
+// SnapshotRecorder
+// ---------------------------------------------------------------------------
+
+SnapshotRecorder::SnapshotRecorder() : dataFd(-1), indexFd(-1), dataSize(0), lastWallTime(0.0)
+{
+}
+
+SnapshotRecorder::~SnapshotRecorder()
+{
+    close();
+}
+
+void SnapshotRecorder::close()
+{
+    if (dataFd >= 0)
+        ::close(dataFd);
+    if (indexFd >= 0)
+        ::close(indexFd);
+    dataFd = indexFd = -1;
+}
+
+// Checks that an existing recording is one this build writes (both headers)
+// and was made on this host, so new records don't land after a header
+// that replay would read them with
+static bool checkExistingRecording(const string &path, int dataFd, uint64_t dataSize, int indexFd, off_t indexSize,
+                                   off_t entries, string &error)
+{
+    if (indexSize > 0)
+    {
+        RecordingIndexHeader header = {};
+        if (pread(indexFd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || header.magic != RECORDING_INDEX_MAGIC ||
+            header.version != RECORDING_INDEX_VERSION || header.entrySize != sizeof(RecordingIndexEntry))
+        {
+            error = indexPath(path) + " is not a recording index of this version; record to a new file";
+            return false;
+        }
+    }
+    if (dataSize == 0)
+    {
+        if (entries > 0)
+        {
+            error = indexPath(path) + " indexes records " + path + " doesn't have; record to a new file";
+            return false;
+        }
+        return true;
+    }
+
+    // The stream header is the magic, the version and four short strings
+    char head[4096];
+    ssize_t n = pread(dataFd, head, sizeof(head), 0);
+    HostInfo recorded;
+    size_t headerLength;
+    if (n <= 0 || !deserializeBinaryHeader(head, n, recorded, headerLength))
+    {
+        error = path + " is not a recording of this version; record to a new file";
+        return false;
+    }
+    HostInfo current = readHostInfo();
+    if (recorded.hostname != current.hostname || recorded.osName != current.osName || recorded.cpuType != current.cpuType)
+    {
+        error = path + " was recorded on another host (" + recorded.hostname + "); record to a new file";
+        return false;
+    }
+    return true;
+}
+
+bool SnapshotRecorder::open(const string &path, string &error)
+{
+    close();
+    dataFd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (dataFd >= 0)
+        indexFd = ::open(indexPath(path).c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    struct stat dataStat, indexStat;
+    if (dataFd < 0 || indexFd < 0 || fstat(dataFd, &dataStat) != 0 || fstat(indexFd, &indexStat) != 0)
+    {
+        error = (dataFd < 0 ? path : indexPath(path)) + ": " + strerror(errno);
+        close();
+        return false;
+    }
+    dataSize = dataStat.st_size;
+
+    off_t entries = indexStat.st_size > (off_t)sizeof(RecordingIndexHeader)
+                        ? (indexStat.st_size - sizeof(RecordingIndexHeader)) / sizeof(RecordingIndexEntry)
+                        : 0;
+    if (!checkExistingRecording(path, dataFd, dataSize, indexFd, indexStat.st_size, entries, error))
+    {
+        close();
+        return false;
+    }
+
+    // A torn entry at the end of an old index would misalign every new one
+    if (indexStat.st_size > 0 && ftruncate(indexFd, sizeof(RecordingIndexHeader) + entries * sizeof(RecordingIndexEntry)) != 0)
+    {
+        error = indexPath(path) + ": " + strerror(errno);
+        close();
+        return false;
+    }
+    if (indexStat.st_size == 0)
+    {
+        RecordingIndexHeader header = {RECORDING_INDEX_MAGIC, RECORDING_INDEX_VERSION, sizeof(RecordingIndexEntry), 0};
+        if (!writeAll(indexFd, (const char *)&header, sizeof(header)))
+        {
+            error = indexPath(path) + ": " + strerror(errno);
+            close();
+            return false;
+        }
+    }
+
+    // New entries continue from the last one's time (see record())
+    lastWallTime = 0.0;
+    RecordingIndexEntry last;
+    if (entries > 0 && pread(indexFd, &last, sizeof(last), sizeof(RecordingIndexHeader) + (entries - 1) * sizeof(last)) == (ssize_t)sizeof(last))
+        lastWallTime = last.wallTime;
+    return true;
+}
+
+bool SnapshotRecorder::record(const Snapshot &snap)
+{
+    if (dataFd < 0)
+        return false;
+
+    buffer.clear();
+    if (dataSize == 0)
+        serializeBinaryHeader(*snap.host, buffer);
+    size_t recordStart = buffer.size();
+    serializeSnapshot(snap, SNAPSHOT_BINARY, buffer);
+
+    RecordingIndexEntry entry = {};
+    // Replay binary-searches by wall time: a clock stepped back must not
+    // make it go backwards
+    entry.wallTime = max(wallClock(), lastWallTime);
+    entry.offset = dataSize + recordStart;
+    entry.length = (uint32_t)(buffer.size() - recordStart);
+    entry.cpuBusy = snap.cpuTotal.busy;
+    for (int m = 0; m < CPU_MODE_COUNT; ++m)
+        entry.cpuMode[m] = snap.cpuTotal.mode[m];
+    entry.fanSpeed = snap.fanSpeed;
+    entry.temperature = snap.cpuTemperature;
+    entry.memoryPercent = snap.memory.usagePercent;
+    entry.swapPercent = snap.swap.usagePercent;
+
+    if (!writeAll(dataFd, buffer.data(), buffer.size()))
+        return false;
+    dataSize += buffer.size();
+    lastWallTime = entry.wallTime;
+    return writeAll(indexFd, (const char *)&entry, sizeof(entry));
+}
+
+// ---------------------------------------------------------------------------
+// SnapshotRecording
+// ---------------------------------------------------------------------------
+
+SnapshotRecording::SnapshotRecording() : data(nullptr), dataLength(0), index(nullptr), indexLength(0), entries(nullptr), count(0)
+{
+}
+
+SnapshotRecording::~SnapshotRecording()
+{
+    close();
+}
+
+void SnapshotRecording::close()
+{
+    if (data)
+        munmap((void *)data, dataLength);
+    if (index)
+        munmap((void *)index, indexLength);
+    data = index = nullptr;
+    entries = nullptr;
+    dataLength = indexLength = count = 0;
+}
+
+// Maps a whole file read-only
+static const char *mapFile(const string &path, size_t &length)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return nullptr;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        length = st.st_size;
+        map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    return map == MAP_FAILED ? nullptr : (const char *)map;
+}
+
+bool SnapshotRecording::open(const string &path, string &error)
+{
+    close();
+    data = mapFile(path, dataLength);
+    index = mapFile(indexPath(path), indexLength);
+    if (!data || !index)
+    {
+        error = "can't read " + path + " and " + indexPath(path);
+        close();
+        return false;
+    }
+
+    size_t headerLength;
+    RecordingIndexHeader header;
+    memcpy(&header, index, min(indexLength, sizeof(header)));
+    if (indexLength < sizeof(header) || header.magic != RECORDING_INDEX_MAGIC ||
+        header.version != RECORDING_INDEX_VERSION || header.entrySize != sizeof(RecordingIndexEntry) ||
+        !deserializeBinaryHeader(data, dataLength, hostInfo, headerLength))
+    {
+        error = path + " is not a recording of this version";
+        close();
+        return false;
+    }
+
+    entries = (const RecordingIndexEntry *)(index + sizeof(header));
+    count = (indexLength - sizeof(header)) / sizeof(RecordingIndexEntry);
+    auto pastEnd = [this](const RecordingIndexEntry &e) {
+        return e.offset > dataLength || e.length > dataLength - e.offset;
+    };
+    // Entries pointing past the data file (written by a later, unsynced append) are ignored
+    while (count > 0 && pastEnd(entries[count - 1]))
+        count--;
+    // Every other entry must be a record after the stream header and after
+    // the previous record: load() hands them to the decoder unchecked
+    uint64_t end = headerLength;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (pastEnd(entries[i]) || entries[i].offset < end)
+        {
+            error = indexPath(path) + " is corrupt (entry " + to_string(i) + ")";
+            close();
+            return false;
+        }
+        end = entries[i].offset + entries[i].length;
+    }
+    if (count == 0)
+    {
+        error = path + " holds no snapshots";
+        close();
+        return false;
+    }
+    return true;
+}
+
+size_t SnapshotRecording::find(double wallTime) const
+{
+    size_t lo = 0, hi = count;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (entries[mid].wallTime <= wallTime)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo > 0 ? lo - 1 : 0;
+}
+
+bool SnapshotRecording::load(size_t i, Snapshot &snap) const
+{
+    if (i >= count)
+        return false;
+    if (!deserializeSnapshot(data + entries[i].offset, entries[i].length, snap))
+        return false;
+    snap.host = make_shared<HostInfo>(hostInfo);
+    return true;
+}
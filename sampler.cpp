@@ -0,0 +1,375 @@
+#include "collector.h"
+
+// Default refresh interval for processes, memory and network (seconds)
+static const double SLOW_INTERVAL = 1.0;
+// Slowest history rate and fastest scan rate accepted (headless agents
+// sample rarely, the GUI's slider stays at 1 Hz and up)
+static const float MIN_HISTORY_FPS = 0.001f;
+static const double MIN_SCAN_INTERVAL = 0.1;
+// How often the cached hostname is checked against uname() (seconds)
+static const double HOST_POLL_INTERVAL = 10.0;
+
+PlotSeriesIds registerPlotSeries(MetricsStore &store)
+{
+    PlotSeriesIds ids;
+    ids.cpu = store.addSeries();
+    for (int m = 0; m < CPU_MODE_COUNT; ++m)
+        ids.cpuModes[m] = store.addSeries();
+    ids.fan = store.addSeries();
+    ids.thermal = store.addSeries();
+    return ids;
+}
+
+void appendPlotSamples(MetricsStore &store, const PlotSeriesIds &ids, double timestamp,
+                       const float (&cpuModes)[CPU_MODE_COUNT], float cpuBusy, float fanSpeed, float temperature)
+{
+    store.append(ids.cpu, timestamp, cpuBusy);
+    for (int m = 0; m < CPU_MODE_COUNT; ++m)
+        store.append(ids.cpuModes[m], timestamp, cpuModes[m]);
+    store.append(ids.fan, timestamp, fanSpeed);
+    store.append(ids.thermal, timestamp, temperature);
+}
+
+Sampler::Sampler(size_t historyRetention)
+    : running(false), paused(false), historyFps(60.0f), scanInterval(SLOW_INTERVAL), processSources(PROC_SOURCE_STAT), hostInfoStale(true),
+      queryChanged(false), expandedChanged(false), store(historyRetention), searchEnabled(false), scans(0)
+{
+    // Publish an empty snapshot so latest() is valid before the first sample
+    auto snap = make_shared<Snapshot>();
+    snap->processes = make_shared<ProcessSnapshot>();
+    snap->host = make_shared<HostInfo>();
+    snap->sensors = make_shared<SensorSnapshot>();
+    snap->network = make_shared<NetworkSnapshot>();
+    current = snap;
+
+    series = registerPlotSeries(store);
+}
+
+Sampler::~Sampler()
+{
+    stop();
+}
+
+void Sampler::start()
+{
+    if (running.exchange(true))
+        return;
+    startTime = chrono::steady_clock::now();
+    worker = thread(&Sampler::run, this);
+}
+
+void Sampler::stop()
+{
+    if (!running.exchange(false))
+        return;
+    {
+        lock_guard<mutex> lock(wakeMutex);
+    }
+    wake.notify_all();
+    worker.join();
+}
+
+shared_ptr<const Snapshot> Sampler::latest() const
+{
+    return atomic_load(&current);
+}
+
+void Sampler::setPaused(bool p)
+{
+    paused = p;
+}
+
+void Sampler::setHistoryRate(float fps)
+{
+    if (!(fps >= MIN_HISTORY_FPS))
+        fps = MIN_HISTORY_FPS;
+    // Wake the sampler so a faster rate takes effect immediately. The change
+    // is made under wakeMutex so it can't slip in between the sampler
+    // checking its wait predicate and blocking (and the wake-up be lost).
+    {
+        lock_guard<mutex> lock(wakeMutex);
+        if (historyFps.exchange(fps) == fps)
+            return;
+    }
+    wake.notify_all();
+}
+
+void Sampler::setScanInterval(double seconds)
+{
+    if (!(seconds >= MIN_SCAN_INTERVAL))
+        seconds = MIN_SCAN_INTERVAL;
+    // Wake the sampler so a shorter interval takes effect immediately
+    {
+        lock_guard<mutex> lock(wakeMutex);
+        if (scanInterval.exchange(seconds) == seconds)
+            return;
+    }
+    wake.notify_all();
+}
+
+void Sampler::setProcessQuery(const string &text)
+{
+    {
+        lock_guard<mutex> lock(queryMutex);
+        if (query == text)
+            return;
+        query = text;
+    }
+    // Wake the sampler so the results don't wait for the next scan
+    {
+        lock_guard<mutex> lock(wakeMutex);
+        queryChanged = true;
+    }
+    wake.notify_all();
+}
+
+void Sampler::setExpandedProcesses(const vector<int> &pids)
+{
+    {
+        lock_guard<mutex> lock(expandedMutex);
+        if (expanded == pids)
+            return;
+        expanded = pids;
+    }
+    // Wake the sampler so a newly expanded process shows its threads now
+    {
+        lock_guard<mutex> lock(wakeMutex);
+        expandedChanged = true;
+    }
+    wake.notify_all();
+}
+
+void Sampler::setProcessSources(unsigned sources)
+{
+    processSources = sources | PROC_SOURCE_STAT;
+}
+
+void Sampler::setStatsWindow(double seconds)
+{
+    for (size_t id = 0; id < store.seriesCount(); ++id)
+        store.setWindow((SeriesId)id, seconds);
+}
+
+void Sampler::setRecorder(shared_ptr<SnapshotRecorder> r)
+{
+    atomic_store(&recorder, r);
+}
+
+void Sampler::setSharedSnapshot(shared_ptr<SharedSnapshotWriter> writer)
+{
+    atomic_store(&sharedSnapshot, writer);
+}
+
+void Sampler::setPublishCallback(function<void(bool)> callback)
+{
+    onPublish = move(callback);
+}
+
+void Sampler::invalidateHostInfo()
+{
+    hostInfoStale = true;
+}
+
+// Plot values, sampled at the history rate
+void Sampler::sampleHistory(Snapshot &snap)
+{
+    // One /proc/stat pass gives the aggregate and every core
+    if (cpuEngine.sample())
+    {
+        snap.cpuTotal = cpuEngine.total();
+        snap.cpuCores.resize(cpuEngine.coreCount());
+        for (size_t i = 0; i < snap.cpuCores.size(); ++i)
+            snap.cpuCores[i] = cpuEngine.core(i);
+    }
+    snap.cpuUsage = snap.cpuTotal.busy;
+    snap.fanSpeed = getFanSpeed();
+    snap.cpuTemperature = getCPUTemperature();
+
+    if (paused)
+        return;
+
+    double now = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    appendPlotSamples(store, series, now, snap.cpuTotal.mode, snap.cpuUsage, snap.fanSpeed, snap.cpuTemperature);
+}
+
+// Processes, memory, network and the system facts, sampled every scan interval
+void Sampler::sampleSlow(Snapshot &snap)
+{
+    // Host facts are gathered once; afterwards only the hostname is polled
+    // (uname, every HOST_POLL_INTERVAL) and the rest is shared by pointer
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    if (hostInfoStale.exchange(false) || !snap.host)
+    {
+        snap.host = make_shared<HostInfo>(readHostInfo());
+        lastHostPoll = now;
+    }
+    else if (now - lastHostPoll > chrono::duration<double>(HOST_POLL_INTERVAL))
+    {
+        string hostname;
+        if (hostnameChanged(*snap.host, hostname))
+        {
+            auto host = make_shared<HostInfo>(*snap.host);
+            host->hostname = hostname;
+            snap.host = host;
+        }
+        lastHostPoll = now;
+    }
+
+    auto sensors = make_shared<SensorSnapshot>();
+    sensors->fanStatus = getFanStatus();
+    sensors->readings = sensorRegistry().readAll();
+    snap.sensors = sensors;
+
+    // One /proc/meminfo pass feeds both the memory and swap views
+    MemInfoFields meminfo = readMemInfo();
+    snap.memory = getDetailedMemoryInfo(meminfo);
+    snap.swap = getDetailedSwapInfo(meminfo);
+    snap.disk = getDetailedDiskInfo();
+
+    // The scan vector and the process table are reused across refreshes;
+    // only the published copy is new
+    auto procs = make_shared<ProcessSnapshot>();
+    procs->scan = ++scans;
+    // Process CPU usage divides the jiffies of one scan by the system's over
+    // the same span, so /proc/stat is read right before /proc/[pid]/stat.
+    // This read is also the history sample of the tick (the plot loses none).
+    sampleHistory(snap);
+    procs->cpuStats = cpuEngine.counters();
+    getAllProcesses(scan, processSources);
+    processTable.update(scan, procs->cpuStats);
+    procs->processes = scan;
+    processTree.update(scan, processTable.startedPids(), processTable.exitedPids());
+    processTree.publish(*procs);
+    if (searchEnabled)
+        processSearch.update(scan, processTable.startedPids(), processTable.exitedPids());
+
+    snap.totalProcesses = (int)procs->processes.size();
+    snap.processes = procs;
+    searchProcesses(snap);
+    sampleThreads(snap, true);
+
+    auto network = make_shared<NetworkSnapshot>();
+    network->ip4s = getIPv4Addresses();
+    getNetStats(network->rxStats, network->txStats);
+    snap.network = network;
+}
+
+// Runs the current process query over snap.processes
+void Sampler::searchProcesses(Snapshot &snap)
+{
+    string text;
+    {
+        lock_guard<mutex> lock(queryMutex);
+        text = query;
+    }
+    if (text.find_first_not_of(" \t") == string::npos)
+    {
+        snap.processMatches = nullptr;
+        return;
+    }
+    // The index (and its /proc/[pid]/cmdline reads) only exists once
+    // somebody searched; from then on it follows every scan
+    if (!searchEnabled)
+    {
+        processSearch.update(snap.processes->processes, {}, {});
+        searchEnabled = true;
+    }
+    auto matches = make_shared<ProcessMatches>();
+    processSearch.search(text, snap.processes->processes, *matches);
+    snap.processMatches = matches;
+}
+
+// Reads the threads of the expanded processes. Between scans (refresh
+// unset) only newly expanded processes are read: their CPU usage needs the
+// next scan, and the others keep the values of the last one.
+void Sampler::sampleThreads(Snapshot &snap, bool refresh)
+{
+    vector<int> pids;
+    {
+        lock_guard<mutex> lock(expandedMutex);
+        pids = expanded;
+    }
+    auto threads = make_shared<ProcessThreads>();
+    threadSampler.sample(pids, cpuEngine.counters(), refresh, *threads);
+    snap.threads = pids.empty() ? nullptr : threads;
+}
+
+void Sampler::publish(Snapshot &snap)
+{
+    snap.sequence++;
+    snap.timestamp = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    atomic_store(&current, shared_ptr<const Snapshot>(make_shared<Snapshot>(snap)));
+}
+
+// Sampler thread: run each collector group when it is due, then sleep
+// until the next deadline (or until stop()/setHistoryRate() wakes us).
+void Sampler::run()
+{
+    using clock = chrono::steady_clock;
+
+    // Working copy; every publish hands out a copy of it
+    Snapshot snap = *latest();
+    clock::time_point nextHistory = clock::now();
+    clock::time_point nextSlow = clock::now();
+
+    while (running)
+    {
+        clock::time_point now = clock::now();
+        bool changed = false; // something besides the plot values
+        bool ticked = false;
+        bool scanDue = now >= nextSlow;
+
+        // A due scan takes this tick's history sample itself (see sampleSlow)
+        if (now >= nextHistory && !scanDue)
+        {
+            sampleHistory(snap);
+            nextHistory = now + chrono::duration_cast<clock::duration>(chrono::duration<double>(1.0 / historyFps));
+            // Paused plots take no samples; the values wait for the next scan
+            ticked = !paused;
+        }
+        if (queryChanged.exchange(false))
+        {
+            searchProcesses(snap);
+            changed = true;
+        }
+        if (expandedChanged.exchange(false))
+        {
+            sampleThreads(snap, false);
+            changed = true;
+        }
+        bool scanned = false;
+        if (scanDue)
+        {
+            sampleSlow(snap);
+            nextSlow = now + chrono::duration_cast<clock::duration>(chrono::duration<double>(scanInterval));
+            nextHistory = now + chrono::duration_cast<clock::duration>(chrono::duration<double>(1.0 / historyFps));
+            changed = true;
+            scanned = true;
+        }
+        if (changed || ticked)
+        {
+            publish(snap);
+            shared_ptr<SharedSnapshotWriter> shm = atomic_load(&sharedSnapshot);
+            if (shm)
+                shm->publish(snap);
+            if (onPublish)
+                onPublish(!changed);
+        }
+        // Recordings get one snapshot per process scan, not every plot frame
+        shared_ptr<SnapshotRecorder> r = atomic_load(&recorder);
+        if (scanned && r)
+            r->record(snap);
+
+        unique_lock<mutex> lock(wakeMutex);
+        float fps = historyFps;
+        double interval = scanInterval;
+        wake.wait_until(lock, min(nextSlow, nextHistory), [&] {
+            return !running || historyFps != fps || scanInterval != interval || queryChanged || expandedChanged;
+        });
+        // A new rate shortens the pending wait instead of finishing it
+        if (historyFps != fps)
+            nextHistory = min(nextHistory, clock::now() + chrono::duration_cast<clock::duration>(chrono::duration<double>(1.0 / historyFps)));
+        if (scanInterval != interval)
+            nextSlow = min(nextSlow, clock::now() + chrono::duration_cast<clock::duration>(chrono::duration<double>(scanInterval)));
+    }
+}
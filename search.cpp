@@ -0,0 +1,428 @@
+#include "collector.h"
+#include <algorithm>  // For std::sort
+#include <pwd.h>      // For getpwuid_r
+#include <regex>      // For std::regex
+#include <sys/stat.h> // For fstatat
+
+// Longest command line kept per process; enough for any search anyone types
+static const size_t SEARCH_CMDLINE_MAX = 4096;
+// Postings of removed documents are dropped once they outnumber live ones
+static const size_t SEARCH_COMPACT_MIN = 4096;
+
+static inline char lowerAscii(char c)
+{
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+static string toLower(const string &s)
+{
+    string out(s);
+    for (char &c : out)
+        c = lowerAscii(c);
+    return out;
+}
+
+static inline uint32_t trigramAt(const char *s)
+{
+    return (uint32_t)(unsigned char)s[0] << 16 | (uint32_t)(unsigned char)s[1] << 8 | (unsigned char)s[2];
+}
+
+// Distinct trigrams of an already lowercased string
+static void trigramsOf(const string &text, vector<uint32_t> &out)
+{
+    out.clear();
+    for (size_t i = 0; i + 3 <= text.size(); ++i)
+        out.push_back(trigramAt(text.data() + i));
+    sort(out.begin(), out.end());
+    out.erase(unique(out.begin(), out.end()), out.end());
+}
+
+ProcessSearch::ProcessSearch() : livePostings(0), stalePostings(0), stamp(0)
+{
+}
+
+// Owner of /proc/<pid>; false if the process is gone
+bool ProcessSearch::ownerOf(int pid, uid_t &uid) const
+{
+    char path[16];
+    snprintf(path, sizeof(path), "%d", pid);
+    struct stat st;
+    if (proc.fd() < 0 || fstatat(proc.fd(), path, &st, 0) != 0)
+        return false;
+    uid = st.st_uid;
+    return true;
+}
+
+const string &ProcessSearch::userName(uid_t uid)
+{
+    auto it = userNames.find(uid);
+    if (it != userNames.end())
+        return it->second;
+    struct passwd pw, *found = nullptr;
+    char buffer[1024];
+    string name = getpwuid_r(uid, &pw, buffer, sizeof(buffer), &found) == 0 && found
+                      ? string(found->pw_name)
+                      : to_string(uid);
+    return userNames.emplace(uid, name).first->second;
+}
+
+// Adds a document for p (processes[index]), reading its command line and
+// owner from /proc when readProc is set
+void ProcessSearch::add(const Proc &p, int index, bool readProc)
+{
+    uint32_t id;
+    if (!freeDocs.empty())
+    {
+        id = freeDocs.back();
+        freeDocs.pop_back();
+    }
+    else
+    {
+        id = (uint32_t)docs.size();
+        docs.emplace_back();
+    }
+
+    Document &doc = docs[id];
+    doc.pid = p.pid;
+    doc.index = index;
+    doc.live = true;
+    doc.name = p.name;
+    doc.starttime = p.starttime;
+    doc.argStart = p.argStart;
+    doc.uid = (uid_t)-1;
+    doc.cmdline.clear();
+    doc.user.clear();
+    if (readProc)
+    {
+        char buffer[SEARCH_CMDLINE_MAX];
+        ssize_t n = proc.readFile(p.pid, "cmdline", buffer, sizeof(buffer));
+        // Arguments are NUL-separated (and NUL-terminated)
+        while (n > 0 && buffer[n - 1] == '\0')
+            n--;
+        if (n > 0)
+        {
+            replace(buffer, buffer + n, '\0', ' ');
+            doc.cmdline.assign(buffer, n);
+        }
+        if (ownerOf(p.pid, doc.uid))
+            doc.user = userName(doc.uid);
+    }
+
+    // Name and command line share one lowercased text (and trigram set)
+    doc.text = toLower(doc.name);
+    doc.text += '\n';
+    doc.text += toLower(doc.cmdline);
+
+    trigramsOf(doc.text, scratch);
+    for (uint32_t t : scratch)
+        postings[t].push_back(id);
+    doc.trigrams = (uint32_t)scratch.size();
+    livePostings += scratch.size();
+    byPid[p.pid] = id;
+}
+
+// Drops a document; its postings go stale and are filtered out by the
+// verification every candidate goes through, until the next compaction
+void ProcessSearch::remove(uint32_t id)
+{
+    Document &doc = docs[id];
+    doc.live = false;
+    livePostings -= doc.trigrams;
+    stalePostings += doc.trigrams;
+    freeDocs.push_back(id);
+}
+
+void ProcessSearch::compact()
+{
+    postings.clear();
+    for (uint32_t id = 0; id < docs.size(); ++id)
+    {
+        if (!docs[id].live)
+            continue;
+        trigramsOf(docs[id].text, scratch);
+        for (uint32_t t : scratch)
+            postings[t].push_back(id);
+    }
+    stalePostings = 0;
+}
+
+void ProcessSearch::update(const vector<Proc> &processes, const vector<int> &started, const vector<int> &exited)
+{
+    for (int pid : exited)
+    {
+        auto it = byPid.find(pid);
+        if (it != byPid.end())
+        {
+            remove(it->second);
+            byPid.erase(it);
+        }
+    }
+
+    // A recycled pid is in both lists: removed above, added below
+    for (int pid : started)
+        byPid.emplace(pid, UINT32_MAX);
+
+    for (size_t i = 0; i < processes.size(); ++i)
+    {
+        const Proc &p = processes[i];
+        auto it = byPid.find(p.pid);
+        if (it == byPid.end() || it->second == UINT32_MAX)
+        {
+            add(p, (int)i, true);
+            continue;
+        }
+        Document &doc = docs[it->second];
+        // exec() keeps the pid but changes the command line (and moves argv,
+        // even when the name stays), setuid() changes the owner, and a
+        // different start time is a recycled pid
+        uid_t uid;
+        if (doc.name != p.name || doc.argStart != p.argStart || doc.starttime != p.starttime ||
+            (ownerOf(p.pid, uid) && uid != doc.uid))
+        {
+            remove(it->second);
+            add(p, (int)i, true);
+            continue;
+        }
+        doc.index = (int)i;
+    }
+
+    // Started pids that were gone again before the scan finished
+    for (int pid : started)
+    {
+        auto it = byPid.find(pid);
+        if (it != byPid.end() && it->second == UINT32_MAX)
+            byPid.erase(it);
+    }
+
+    if (stalePostings > SEARCH_COMPACT_MIN && stalePostings > livePostings)
+        compact();
+}
+
+void ProcessSearch::rebuild(const vector<Proc> &processes)
+{
+    docs.clear();
+    freeDocs.clear();
+    byPid.clear();
+    postings.clear();
+    livePostings = stalePostings = 0;
+    for (size_t i = 0; i < processes.size(); ++i)
+        add(processes[i], (int)i, false);
+}
+
+// ---------------------------------------------------------------------------
+// Queries
+// ---------------------------------------------------------------------------
+
+// One whitespace-separated part of a query; all of them must match
+struct SearchTerm
+{
+    enum Kind
+    {
+        TEXT,      // name or command line contains (case-insensitive)
+        NAME,      // name:
+        CMDLINE,   // cmd:
+        USER,      // user: exact user name
+        STATE,     // state: one of the given state letters
+        CPU_ABOVE, // cpu>
+        CPU_BELOW, // cpu<
+        PID,       // pid:
+        REGEX,     // re: or /.../, over name and command line
+    } kind;
+    string text;
+    double number;
+    shared_ptr<regex> pattern;
+};
+
+static bool hasPrefix(const string &s, const char *prefix, string &rest)
+{
+    size_t n = strlen(prefix);
+    if (s.compare(0, n, prefix) != 0)
+        return false;
+    rest = s.substr(n);
+    return true;
+}
+
+static bool parseNumber(const string &text, double &value)
+{
+    char *end;
+    value = strtod(text.c_str(), &end);
+    return !text.empty() && *end == '\0';
+}
+
+// Splits a query into terms; returns false and sets error on bad input
+static bool parseQuery(const string &query, vector<SearchTerm> &terms, string &error)
+{
+    size_t i = 0;
+    while (i < query.size())
+    {
+        while (i < query.size() && isspace((unsigned char)query[i]))
+            i++;
+        size_t start = i;
+        while (i < query.size() && !isspace((unsigned char)query[i]))
+            i++;
+        if (start == i)
+            break;
+        string token = query.substr(start, i - start), rest;
+
+        SearchTerm term;
+        term.number = 0.0;
+        if (hasPrefix(token, "user:", rest))
+        {
+            term.kind = SearchTerm::USER;
+            term.text = rest;
+        }
+        else if (hasPrefix(token, "state:", rest))
+        {
+            term.kind = SearchTerm::STATE;
+            term.text = rest;
+        }
+        else if (hasPrefix(token, "name:", rest))
+        {
+            term.kind = SearchTerm::NAME;
+            term.text = toLower(rest);
+        }
+        else if (hasPrefix(token, "cmd:", rest))
+        {
+            term.kind = SearchTerm::CMDLINE;
+            term.text = toLower(rest);
+        }
+        else if (hasPrefix(token, "cpu>", rest) || hasPrefix(token, "cpu<", rest) || hasPrefix(token, "pid:", rest))
+        {
+            term.kind = token[0] == 'p' ? SearchTerm::PID : token[3] == '>' ? SearchTerm::CPU_ABOVE : SearchTerm::CPU_BELOW;
+            if (!parseNumber(rest, term.number))
+            {
+                error = "not a number: " + token;
+                return false;
+            }
+        }
+        else if (hasPrefix(token, "re:", rest) || (token.size() > 2 && token.front() == '/' && token.back() == '/'))
+        {
+            term.kind = SearchTerm::REGEX;
+            term.text = token[0] == '/' ? token.substr(1, token.size() - 2) : rest;
+            try
+            {
+                term.pattern = make_shared<regex>(term.text, regex::ECMAScript | regex::icase | regex::optimize);
+            }
+            catch (const regex_error &e)
+            {
+                error = "bad regex " + term.text + ": " + e.what();
+                return false;
+            }
+        }
+        else
+        {
+            term.kind = SearchTerm::TEXT;
+            term.text = toLower(token);
+        }
+
+        // A bare qualifier ("user:") is still being typed; it matches everything
+        if (term.text.empty() && term.kind != SearchTerm::CPU_ABOVE && term.kind != SearchTerm::CPU_BELOW && term.kind != SearchTerm::PID)
+            continue;
+        terms.push_back(move(term));
+    }
+    return true;
+}
+
+bool ProcessSearch::matches(const Document &doc, const Proc &p, const vector<SearchTerm> &terms) const
+{
+    size_t nameEnd = doc.name.size();
+    for (const SearchTerm &term : terms)
+    {
+        bool ok = true;
+        switch (term.kind)
+        {
+        case SearchTerm::TEXT:
+            ok = doc.text.find(term.text) != string::npos;
+            break;
+        case SearchTerm::NAME:
+            ok = doc.text.find(term.text) < nameEnd;
+            break;
+        case SearchTerm::CMDLINE:
+            ok = doc.text.find(term.text, nameEnd + 1) != string::npos;
+            break;
+        case SearchTerm::USER:
+            ok = doc.user == term.text;
+            break;
+        case SearchTerm::STATE:
+            ok = false;
+            for (char c : term.text)
+                ok = ok || toupper((unsigned char)c) == toupper((unsigned char)p.state);
+            break;
+        case SearchTerm::CPU_ABOVE:
+            ok = p.cpuUsage > term.number;
+            break;
+        case SearchTerm::CPU_BELOW:
+            ok = p.cpuUsage < term.number;
+            break;
+        case SearchTerm::PID:
+            ok = p.pid == (int)term.number;
+            break;
+        case SearchTerm::REGEX:
+            ok = regex_search(doc.name, *term.pattern) || regex_search(doc.cmdline, *term.pattern);
+            break;
+        }
+        if (!ok)
+            return false;
+    }
+    return true;
+}
+
+void ProcessSearch::search(const string &query, const vector<Proc> &processes, ProcessMatches &result)
+{
+    result.query = query;
+    result.error.clear();
+    result.indices.clear();
+
+    vector<SearchTerm> terms;
+    if (!parseQuery(query, terms, result.error))
+        return;
+
+    // Candidates come from the rarest trigram of any substring term; a
+    // trigram nobody has means no process can match
+    const vector<uint32_t> *candidates = nullptr;
+    for (const SearchTerm &term : terms)
+    {
+        if (term.kind != SearchTerm::TEXT && term.kind != SearchTerm::NAME && term.kind != SearchTerm::CMDLINE)
+            continue;
+        for (size_t i = 0; i + 3 <= term.text.size(); ++i)
+        {
+            auto it = postings.find(trigramAt(term.text.data() + i));
+            if (it == postings.end())
+                return;
+            if (!candidates || it->second.size() < candidates->size())
+                candidates = &it->second;
+        }
+    }
+
+    auto check = [&](uint32_t id) {
+        const Document &doc = docs[id];
+        if (doc.live && doc.index >= 0 && doc.index < (int)processes.size() &&
+            processes[doc.index].pid == doc.pid && matches(doc, processes[doc.index], terms))
+            result.indices.push_back(doc.index);
+    };
+
+    if (candidates)
+    {
+        // Postings can repeat a document (a reused slot): visit each once
+        if (seen.size() < docs.size())
+            seen.resize(docs.size(), 0);
+        if (++stamp == 0)
+        {
+            fill(seen.begin(), seen.end(), 0);
+            stamp = 1;
+        }
+        for (uint32_t id : *candidates)
+        {
+            if (seen[id] == stamp)
+                continue;
+            seen[id] = stamp;
+            check(id);
+        }
+    }
+    else
+    {
+        for (uint32_t id = 0; id < docs.size(); ++id)
+            check(id);
+    }
+    sort(result.indices.begin(), result.indices.end());
+}
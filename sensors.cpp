@@ -0,0 +1,185 @@
+#include "collector.h"
+#include <algorithm> // For std::sort
+
+// How often the sensor directories are enumerated again, so hot-plugged
+// devices and late-loaded drivers show up (seconds)
+static const double SENSOR_RESCAN_INTERVAL = 30.0;
+
+// Reads a short sysfs attribute (e.g. "name", "type") without the newline
+static string readAttribute(const string &path)
+{
+    ProcFile file(path.c_str());
+    const char *text = file.read();
+    if (!text)
+        return "";
+    string value(text);
+    while (!value.empty() && (value.back() == '\n' || value.back() == ' '))
+        value.pop_back();
+    return value;
+}
+
+// Number at the end of a name like "hwmon3" or "thermal_zone12", for ordering
+static int trailingNumber(const string &name)
+{
+    size_t pos = name.find_last_not_of("0123456789");
+    return pos + 1 < name.size() ? atoi(name.c_str() + pos + 1) : -1;
+}
+
+// Sorted entries of dir whose name starts with prefix
+static vector<string> listEntries(const string &dir, const char *prefix)
+{
+    vector<string> names;
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return names;
+    size_t prefixLength = strlen(prefix);
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL)
+    {
+        if (strncmp(ent->d_name, prefix, prefixLength) == 0)
+            names.push_back(ent->d_name);
+    }
+    closedir(d);
+    sort(names.begin(), names.end(), [](const string &a, const string &b) {
+        int na = trailingNumber(a), nb = trailingNumber(b);
+        return na != nb ? na < nb : a < b;
+    });
+    return names;
+}
+
+SensorRegistry::SensorRegistry(const string &hwmonRoot, const string &thermalRoot)
+    : hwmonRoot(hwmonRoot), thermalRoot(thermalRoot), fan(-1), temperature(-1), scanned(false)
+{
+}
+
+void SensorRegistry::addSensor(SensorType type, const string &label, const string &path, float scale)
+{
+    auto file = make_unique<ProcFile>(path.c_str());
+    if (!file->isOpen())
+        return;
+    Sensor sensor;
+    sensor.type = type;
+    sensor.label = label;
+    sensor.scale = scale;
+    sensor.value = 0.0f;
+    sensor.file = move(file);
+    entries.push_back(move(sensor));
+}
+
+// Enumerates hwmon fans/temperatures and thermal zones and opens their
+// input files. Only this pays for directory walks and failed opens.
+void SensorRegistry::rescan()
+{
+    entries.clear();
+    fan = -1;
+    temperature = -1;
+
+    // Thermal zones first: the CPU temperature has always come from the first zone
+    for (const string &zone : listEntries(thermalRoot, "thermal_zone"))
+    {
+        string dir = thermalRoot + "/" + zone;
+        string type = readAttribute(dir + "/type");
+        addSensor(SENSOR_TEMPERATURE, zone + (type.empty() ? "" : ": " + type), dir + "/temp", 0.001f);
+    }
+
+    for (const string &hwmon : listEntries(hwmonRoot, "hwmon"))
+    {
+        string dir = hwmonRoot + "/" + hwmon;
+        string chip = readAttribute(dir + "/name");
+        if (chip.empty())
+            chip = hwmon;
+
+        DIR *d = opendir(dir.c_str());
+        if (!d)
+            continue;
+        vector<string> inputs;
+        struct dirent *ent;
+        while ((ent = readdir(d)) != NULL)
+        {
+            size_t length = strlen(ent->d_name);
+            bool isInput = length > 6 && strcmp(ent->d_name + length - 6, "_input") == 0;
+            if (isInput && (strncmp(ent->d_name, "fan", 3) == 0 || strncmp(ent->d_name, "temp", 4) == 0))
+                inputs.push_back(string(ent->d_name, length - 6));
+        }
+        closedir(d);
+        sort(inputs.begin(), inputs.end(), [](const string &a, const string &b) {
+            return a[0] != b[0] ? a[0] < b[0] : trailingNumber(a) < trailingNumber(b);
+        });
+
+        for (const string &input : inputs)
+        {
+            bool isFan = input[0] == 'f';
+            string label = readAttribute(dir + "/" + input + "_label");
+            addSensor(isFan ? SENSOR_FAN : SENSOR_TEMPERATURE,
+                      chip + ": " + (label.empty() ? input : label),
+                      dir + "/" + input + "_input",
+                      isFan ? 1.0f : 0.001f);
+        }
+    }
+
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        if (entries[i].type == SENSOR_FAN && fan < 0)
+            fan = (int)i;
+        if (entries[i].type == SENSOR_TEMPERATURE && temperature < 0)
+            temperature = (int)i;
+    }
+
+    lastScan = chrono::steady_clock::now();
+    scanned = true;
+}
+
+void SensorRegistry::rescanIfStale()
+{
+    if (!scanned || chrono::steady_clock::now() - lastScan > chrono::duration<double>(SENSOR_RESCAN_INTERVAL))
+        rescan();
+}
+
+// pread()s one sensor; returns its value in RPM or Celsius
+float SensorRegistry::read(Sensor &sensor)
+{
+    const char *text = sensor.file->read();
+    if (text)
+    {
+        bool negative = *text == '-';
+        unsigned long long raw = 0;
+        if (parseUnsignedRun(text + negative, text + strlen(text), &raw, 1) == 1)
+            sensor.value = (negative ? -(float)raw : (float)raw) * sensor.scale;
+    }
+    return sensor.value;
+}
+
+float SensorRegistry::readFanSpeed()
+{
+    rescanIfStale();
+    return fan >= 0 ? read(entries[fan]) : 0.0f;
+}
+
+float SensorRegistry::readTemperature()
+{
+    rescanIfStale();
+    return temperature >= 0 ? read(entries[temperature]) : 0.0f;
+}
+
+bool SensorRegistry::hasFan()
+{
+    rescanIfStale();
+    return fan >= 0;
+}
+
+vector<SensorReading> SensorRegistry::readAll()
+{
+    rescanIfStale();
+    vector<SensorReading> readings;
+    readings.reserve(entries.size());
+    for (Sensor &sensor : entries)
+        readings.push_back({sensor.type, sensor.label, read(sensor)});
+    return readings;
+}
+
+// Registry behind getFanStatus/getFanSpeed/getCPUTemperature
+SensorRegistry &sensorRegistry()
+{
+    static SensorRegistry registry;
+    return registry;
+}
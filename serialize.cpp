@@ -0,0 +1,418 @@
+#include "collector.h"
+
+// ---------------------------------------------------------------------------
+// NDJSON: one object per snapshot, one line per object
+// ---------------------------------------------------------------------------
+
+static void appendf(string &out, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static void appendf(string &out, const char *format, ...)
+{
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length > 0)
+        out.append(buffer, min((size_t)length, sizeof(buffer) - 1));
+}
+
+// Appends a JSON string literal; process names may hold any byte but NUL
+static void appendJsonString(string &out, const string &text)
+{
+    out += '"';
+    for (unsigned char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += (char)c;
+        }
+        else if (c < 0x20)
+        {
+            appendf(out, "\\u%04x", c);
+        }
+        else
+        {
+            out += (char)c;
+        }
+    }
+    out += '"';
+}
+
+// Prints finite floats compactly; JSON has no NaN or infinity
+static void appendJsonNumber(string &out, double value)
+{
+    if (isfinite(value))
+        appendf(out, "%.6g", value);
+    else
+        out += "null";
+}
+
+static void appendJsonModes(string &out, const float (&mode)[CPU_MODE_COUNT])
+{
+    for (int m = 0; m < CPU_MODE_COUNT; ++m)
+    {
+        appendf(out, ",\"%s\":", cpuModeName((CpuMode)m));
+        appendJsonNumber(out, mode[m]);
+    }
+}
+
+static void serializeJson(const Snapshot &snap, string &out)
+{
+    appendf(out, "{\"seq\":%llu,\"time\":", snap.sequence);
+    appendJsonNumber(out, snap.timestamp);
+
+    out += ",\"host\":{\"os\":";
+    appendJsonString(out, snap.host->osName);
+    out += ",\"cpu\":";
+    appendJsonString(out, snap.host->cpuType);
+    out += ",\"hostname\":";
+    appendJsonString(out, snap.host->hostname);
+    out += ",\"user\":";
+    appendJsonString(out, snap.host->loggedInUser);
+    appendf(out, "},\"processCount\":%d", snap.totalProcesses);
+
+    out += ",\"cpu\":{\"busy\":";
+    appendJsonNumber(out, snap.cpuTotal.busy);
+    appendJsonModes(out, snap.cpuTotal.mode);
+    out += ",\"cores\":[";
+    for (size_t i = 0; i < snap.cpuCores.size(); ++i)
+    {
+        const CpuCoreUsage &core = snap.cpuCores[i];
+        appendf(out, "%s{\"id\":%d,\"busy\":", i ? "," : "", core.id);
+        appendJsonNumber(out, core.busy);
+        appendJsonModes(out, core.mode);
+        out += '}';
+    }
+    out += "]}";
+
+    out += ",\"sensors\":[";
+    for (size_t i = 0; i < snap.sensors->readings.size(); ++i)
+    {
+        const SensorReading &sensor = snap.sensors->readings[i];
+        out += i ? ",{\"label\":" : "{\"label\":";
+        appendJsonString(out, sensor.label);
+        out += sensor.type == SENSOR_FAN ? ",\"type\":\"fan\",\"rpm\":" : ",\"type\":\"temperature\",\"celsius\":";
+        appendJsonNumber(out, sensor.value);
+        out += '}';
+    }
+    out += ']';
+
+    const MemoryInfo &mem = snap.memory;
+    appendf(out, ",\"memory\":{\"totalGB\":%.6g,\"usedGB\":%.6g,\"freeGB\":%.6g,\"availableGB\":%.6g,\"buffCacheGB\":%.6g",
+            mem.totalGB, mem.usedGB, mem.freeGB, mem.availableGB, mem.buffCacheGB);
+    appendf(out, ",\"dirtyGB\":%.6g,\"writebackGB\":%.6g,\"slabGB\":%.6g,\"shmemGB\":%.6g,\"anonHugePagesGB\":%.6g}",
+            mem.dirtyGB, mem.writebackGB, mem.slabGB, mem.shmemGB, mem.anonHugePagesGB);
+    appendf(out, ",\"swap\":{\"totalGB\":%.6g,\"usedGB\":%.6g,\"freeGB\":%.6g}",
+            snap.swap.totalGB, snap.swap.usedGB, snap.swap.freeGB);
+    appendf(out, ",\"disk\":{\"totalGB\":%.6g,\"usedGB\":%.6g,\"availableGB\":%.6g}",
+            snap.disk.totalGB, snap.disk.usedGB, snap.disk.availableGB);
+
+    out += ",\"processes\":[";
+    const vector<Proc> &processes = snap.processes->processes;
+    for (size_t i = 0; i < processes.size(); ++i)
+    {
+        const Proc &p = processes[i];
+        appendf(out, "%s{\"pid\":%d,\"ppid\":%d,\"pgrp\":%d,\"session\":%d,\"name\":", i ? "," : "", p.pid, p.ppid, p.pgrp, p.session);
+        appendJsonString(out, p.name);
+        appendf(out, ",\"state\":\"%c\",\"cpu\":", isprint((unsigned char)p.state) && p.state != '"' && p.state != '\\' ? p.state : '?');
+        appendJsonNumber(out, p.cpuUsage);
+        appendf(out, ",\"rssKB\":%lld,\"vsize\":%lld,\"swapKB\":%lld}", p.rss, p.vsize, p.swap);
+    }
+    out += ']';
+
+    out += ",\"network\":{";
+    bool first = true;
+    for (const auto &rx : snap.network->rxStats)
+    {
+        auto tx = snap.network->txStats.find(rx.first);
+        out += first ? "" : ",";
+        first = false;
+        appendJsonString(out, rx.first);
+        const RX &r = rx.second;
+        appendf(out, ":{\"rx\":{\"bytes\":%llu,\"packets\":%d,\"errs\":%d,\"drop\":%d,\"fifo\":%d,\"colls\":%d,\"carrier\":%d,\"compressed\":%d}",
+                r.bytes, r.packets, r.errs, r.drop, r.fifo, r.colls, r.carrier, r.compressed);
+        if (tx != snap.network->txStats.end())
+        {
+            const TX &t = tx->second;
+            appendf(out, ",\"tx\":{\"bytes\":%llu,\"packets\":%d,\"errs\":%d,\"drop\":%d,\"fifo\":%d,\"frame\":%d,\"compressed\":%d,\"multicast\":%d}",
+                    t.bytes, t.packets, t.errs, t.drop, t.fifo, t.frame, t.compressed, t.multicast);
+        }
+        out += '}';
+    }
+    out += "}}\n";
+}
+
+// ---------------------------------------------------------------------------
+// Binary: fixed-width fields in host byte order, strings length-prefixed
+// ---------------------------------------------------------------------------
+
+template <typename T>
+static void put(string &out, T value)
+{
+    out.append((const char *)&value, sizeof(value));
+}
+
+// Strings longer than 255 bytes are cut; process and interface names are far shorter
+static void putString(string &out, const string &text)
+{
+    uint8_t length = (uint8_t)min(text.size(), (size_t)255);
+    put(out, length);
+    out.append(text.data(), length);
+}
+
+void serializeBinaryHeader(const HostInfo &host, string &out)
+{
+    put(out, SNAPSHOT_STREAM_MAGIC);
+    put(out, SNAPSHOT_STREAM_VERSION);
+    putString(out, host.osName);
+    putString(out, host.cpuType);
+    putString(out, host.hostname);
+    putString(out, host.loggedInUser);
+}
+
+static void serializeBinary(const Snapshot &snap, string &out)
+{
+    size_t start = out.size();
+    put(out, SNAPSHOT_RECORD_MAGIC);
+    put(out, (uint32_t)0); // record length, patched below
+    put(out, (uint64_t)snap.sequence);
+    put(out, snap.timestamp);
+    put(out, (int32_t)snap.totalProcesses);
+
+    put(out, snap.cpuTotal.busy);
+    for (int m = 0; m < CPU_MODE_COUNT; ++m)
+        put(out, snap.cpuTotal.mode[m]);
+    put(out, (uint16_t)snap.cpuCores.size());
+    for (const CpuCoreUsage &core : snap.cpuCores)
+    {
+        put(out, (int32_t)core.id);
+        put(out, core.busy);
+        for (int m = 0; m < CPU_MODE_COUNT; ++m)
+            put(out, core.mode[m]);
+    }
+    put(out, snap.fanSpeed);
+    put(out, snap.cpuTemperature);
+    putString(out, snap.sensors->fanStatus);
+    put(out, (uint16_t)snap.sensors->readings.size());
+    for (const SensorReading &sensor : snap.sensors->readings)
+    {
+        put(out, (uint8_t)sensor.type);
+        put(out, sensor.value);
+        putString(out, sensor.label);
+    }
+
+    const MemoryInfo &mem = snap.memory;
+    for (double value : {mem.totalGB, mem.usedGB, mem.freeGB, mem.availableGB, mem.buffCacheGB,
+                         mem.dirtyGB, mem.writebackGB, mem.slabGB, mem.shmemGB, mem.anonHugePagesGB})
+        put(out, value);
+    for (double value : {snap.swap.totalGB, snap.swap.usedGB, snap.swap.freeGB,
+                         snap.disk.totalGB, snap.disk.usedGB, snap.disk.availableGB})
+        put(out, value);
+
+    const vector<Proc> &processes = snap.processes->processes;
+    put(out, (uint32_t)processes.size());
+    for (const Proc &p : processes)
+    {
+        put(out, (int32_t)p.pid);
+        put(out, (int32_t)p.ppid);
+        put(out, (int32_t)p.pgrp);
+        put(out, (int32_t)p.session);
+        put(out, p.state);
+        put(out, p.cpuUsage);
+        put(out, (int64_t)p.rss);
+        put(out, (int64_t)p.vsize);
+        put(out, (int64_t)p.swap);
+        putString(out, p.name);
+    }
+
+    put(out, (uint16_t)snap.network->ip4s.size());
+    for (const IP4 &ip : snap.network->ip4s)
+    {
+        putString(out, ip.name);
+        putString(out, ip.addressBuffer);
+    }
+
+    put(out, (uint16_t)snap.network->rxStats.size());
+    for (const auto &rx : snap.network->rxStats)
+    {
+        putString(out, rx.first);
+        const RX &r = rx.second;
+        put(out, (uint64_t)r.bytes);
+        for (int value : {r.packets, r.errs, r.drop, r.fifo, r.colls, r.carrier, r.compressed})
+            put(out, (int32_t)value);
+        auto tx = snap.network->txStats.find(rx.first);
+        TX t = tx != snap.network->txStats.end() ? tx->second : TX();
+        put(out, (uint64_t)t.bytes);
+        for (int value : {t.packets, t.errs, t.drop, t.fifo, t.frame, t.compressed, t.multicast})
+            put(out, (int32_t)value);
+    }
+
+    uint32_t length = (uint32_t)(out.size() - start - 2 * sizeof(uint32_t));
+    memcpy(&out[start + sizeof(uint32_t)], &length, sizeof(length));
+}
+
+// ---------------------------------------------------------------------------
+// Binary decoding, bounds-checked: recordings may be truncated or corrupt
+// ---------------------------------------------------------------------------
+
+struct BinaryReader
+{
+    const char *p;
+    const char *end;
+    bool ok;
+
+    template <typename T>
+    T get()
+    {
+        T value = T();
+        if (!ok || (size_t)(end - p) < sizeof(T))
+        {
+            ok = false;
+            return value;
+        }
+        memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return value;
+    }
+
+    string getString()
+    {
+        uint8_t length = get<uint8_t>();
+        if (!ok || (size_t)(end - p) < length)
+        {
+            ok = false;
+            return string();
+        }
+        string text(p, length);
+        p += length;
+        return text;
+    }
+};
+
+bool deserializeBinaryHeader(const char *data, size_t length, HostInfo &host, size_t &headerLength)
+{
+    BinaryReader in = {data, data + length, true};
+    if (in.get<uint32_t>() != SNAPSHOT_STREAM_MAGIC || in.get<uint32_t>() != SNAPSHOT_STREAM_VERSION)
+        return false;
+    host.osName = in.getString();
+    host.cpuType = in.getString();
+    host.hostname = in.getString();
+    host.loggedInUser = in.getString();
+    headerLength = in.p - data;
+    return in.ok;
+}
+
+bool deserializeSnapshot(const char *data, size_t length, Snapshot &snap)
+{
+    BinaryReader in = {data, data + length, true};
+    if (in.get<uint32_t>() != SNAPSHOT_RECORD_MAGIC)
+        return false;
+    uint32_t recordLength = in.get<uint32_t>();
+    if (!in.ok || recordLength > (size_t)(in.end - in.p))
+        return false;
+    in.end = in.p + recordLength;
+
+    snap.sequence = in.get<uint64_t>();
+    snap.timestamp = in.get<double>();
+    snap.totalProcesses = in.get<int32_t>();
+
+    snap.cpuTotal.id = -1;
+    snap.cpuTotal.busy = in.get<float>();
+    for (int m = 0; m < CPU_MODE_COUNT; ++m)
+        snap.cpuTotal.mode[m] = in.get<float>();
+    snap.cpuUsage = snap.cpuTotal.busy;
+    snap.cpuCores.resize(in.get<uint16_t>());
+    for (CpuCoreUsage &core : snap.cpuCores)
+    {
+        core.id = in.get<int32_t>();
+        core.busy = in.get<float>();
+        for (int m = 0; m < CPU_MODE_COUNT; ++m)
+            core.mode[m] = in.get<float>();
+    }
+    snap.fanSpeed = in.get<float>();
+    snap.cpuTemperature = in.get<float>();
+    auto sensors = make_shared<SensorSnapshot>();
+    sensors->fanStatus = in.getString();
+    sensors->readings.resize(in.get<uint16_t>());
+    for (SensorReading &sensor : sensors->readings)
+    {
+        sensor.type = (SensorType)in.get<uint8_t>();
+        sensor.value = in.get<float>();
+        sensor.label = in.getString();
+    }
+    snap.sensors = sensors;
+
+    MemoryInfo &mem = snap.memory;
+    for (double *value : {&mem.totalGB, &mem.usedGB, &mem.freeGB, &mem.availableGB, &mem.buffCacheGB,
+                          &mem.dirtyGB, &mem.writebackGB, &mem.slabGB, &mem.shmemGB, &mem.anonHugePagesGB})
+        *value = in.get<double>();
+    for (double *value : {&snap.swap.totalGB, &snap.swap.usedGB, &snap.swap.freeGB,
+                          &snap.disk.totalGB, &snap.disk.usedGB, &snap.disk.availableGB})
+        *value = in.get<double>();
+    mem.usagePercent = mem.totalGB > 0 ? (float)(mem.usedGB / mem.totalGB * 100.0) : 0.0f;
+    snap.swap.usagePercent = snap.swap.totalGB > 0 ? (float)(snap.swap.usedGB / snap.swap.totalGB * 100.0) : 0.0f;
+    // Like getDetailedDiskInfo (and df): the space reserved for root counts
+    // as neither used nor available
+    double usableGB = snap.disk.usedGB + snap.disk.availableGB;
+    snap.disk.usagePercent = usableGB > 0 ? (float)(snap.disk.usedGB / usableGB * 100.0) : 0.0f;
+
+    auto procs = make_shared<ProcessSnapshot>();
+    uint32_t processCount = in.get<uint32_t>();
+    // Each process takes at least 46 bytes; don't trust a corrupt count
+    if (!in.ok || processCount > (size_t)(in.end - in.p) / 46)
+        return false;
+    procs->processes.resize(processCount);
+    for (Proc &p : procs->processes)
+    {
+        p = Proc();
+        p.pid = in.get<int32_t>();
+        p.ppid = in.get<int32_t>();
+        p.pgrp = in.get<int32_t>();
+        p.session = in.get<int32_t>();
+        p.state = in.get<char>();
+        p.cpuUsage = in.get<float>();
+        p.rss = in.get<int64_t>();
+        p.vsize = in.get<int64_t>();
+        p.swap = in.get<int64_t>();
+        p.name = in.getString();
+    }
+    // Recordings keep ppids, not the links: rebuild the tree in one go
+    ProcessTree tree;
+    tree.update(procs->processes, {}, {});
+    tree.publish(*procs);
+    snap.processes = procs;
+
+    auto network = make_shared<NetworkSnapshot>();
+    network->ip4s.resize(in.get<uint16_t>());
+    for (IP4 &ip : network->ip4s)
+    {
+        snprintf(ip.name, sizeof(ip.name), "%s", in.getString().c_str());
+        snprintf(ip.addressBuffer, sizeof(ip.addressBuffer), "%s", in.getString().c_str());
+    }
+
+    uint16_t interfaceCount = in.get<uint16_t>();
+    for (uint16_t i = 0; i < interfaceCount && in.ok; ++i)
+    {
+        string name = in.getString();
+        RX &r = network->rxStats[name];
+        r.bytes = in.get<uint64_t>();
+        for (int *value : {&r.packets, &r.errs, &r.drop, &r.fifo, &r.colls, &r.carrier, &r.compressed})
+            *value = in.get<int32_t>();
+        TX &t = network->txStats[name];
+        t.bytes = in.get<uint64_t>();
+        for (int *value : {&t.packets, &t.errs, &t.drop, &t.fifo, &t.frame, &t.compressed, &t.multicast})
+            *value = in.get<int32_t>();
+    }
+    snap.network = network;
+    return in.ok;
+}
+
+void serializeSnapshot(const Snapshot &snap, SnapshotFormat format, string &out)
+{
+    if (format == SNAPSHOT_JSON)
+        serializeJson(snap, out);
+    else
+        serializeBinary(snap, out);
+}
@@ -0,0 +1,194 @@
+#include "collector.h"
+#include <sys/mman.h> // For shm_open, mmap
+
+// The writer side of the seqlock described in monitor_shm.h: seq goes odd,
+// the data is updated in place, seq goes even. There is a single writer
+// (the sampler thread), so the counter needs no read-modify-write.
+
+static const double BYTES_PER_GB = 1024.0 * 1024.0 * 1024.0;
+
+// Copies a string into a fixed field, truncated and NUL-terminated
+template <size_t N>
+static void copyString(char (&field)[N], const string &value)
+{
+    size_t n = min(value.size(), N - 1);
+    memcpy(field, value.data(), n);
+    memset(field + n, 0, N - n);
+}
+
+static uint64_t toBytes(double gb)
+{
+    return gb > 0.0 ? (uint64_t)(gb * BYTES_PER_GB) : 0;
+}
+
+static void copyCpu(struct monitor_shm_cpu &out, const CpuCoreUsage &in)
+{
+    static_assert((int)MONITOR_SHM_CPU_MODES == (int)CPU_MODE_COUNT, "monitor_shm.h and CpuMode disagree");
+    out.id = in.id;
+    out.busy = in.busy;
+    for (int m = 0; m < CPU_MODE_COUNT; ++m)
+        out.mode[m] = in.mode[m];
+}
+
+SharedSnapshotWriter::SharedSnapshotWriter() : shm(nullptr)
+{
+}
+
+SharedSnapshotWriter::~SharedSnapshotWriter()
+{
+    close();
+}
+
+bool SharedSnapshotWriter::open(const string &segment)
+{
+    close();
+    int fd = shm_open(segment.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+    void *map = MAP_FAILED;
+    if (ftruncate(fd, sizeof(struct monitor_shm)) == 0)
+        map = mmap(nullptr, sizeof(struct monitor_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+    {
+        shm_unlink(segment.c_str());
+        return false;
+    }
+
+    name = segment;
+    shm = (struct monitor_shm *)map;
+    // Taking over a segment left by an earlier run: keep its counter moving
+    // forward (and even) so readers that kept it mapped see a new snapshot
+    uint64_t seq = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&shm->seq, (seq + 1) & ~1ULL, __ATOMIC_RELAXED);
+    shm->version = MONITOR_SHM_VERSION;
+    shm->size = sizeof(struct monitor_shm);
+    shm->pid = getpid();
+    __atomic_store_n(&shm->magic, MONITOR_SHM_MAGIC, __ATOMIC_RELEASE);
+    lastHost.reset();
+    lastProcesses.reset();
+    return true;
+}
+
+void SharedSnapshotWriter::close()
+{
+    if (!shm)
+        return;
+    munmap(shm, sizeof(struct monitor_shm));
+    shm_unlink(name.c_str());
+    shm = nullptr;
+    lastHost.reset();
+    lastProcesses.reset();
+}
+
+void SharedSnapshotWriter::publish(const Snapshot &snap)
+{
+    if (!shm)
+        return;
+
+    uint64_t seq = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    struct monitor_shm_data &d = shm->data;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    d.sequence = snap.sequence;
+    d.timestamp = snap.timestamp;
+    d.wall_time = now.tv_sec + now.tv_nsec / 1e9;
+
+    if (snap.host != lastHost)
+    {
+        copyString(d.hostname, snap.host->hostname);
+        copyString(d.os_name, snap.host->osName);
+        copyString(d.cpu_type, snap.host->cpuType);
+        lastHost = snap.host;
+    }
+
+    d.total_processes = snap.totalProcesses;
+    d.fan_speed = snap.fanSpeed;
+    d.cpu_temperature = snap.cpuTemperature;
+
+    d.memory_total_bytes = toBytes(snap.memory.totalGB);
+    d.memory_used_bytes = toBytes(snap.memory.usedGB);
+    d.memory_free_bytes = toBytes(snap.memory.freeGB);
+    d.memory_available_bytes = toBytes(snap.memory.availableGB);
+    d.memory_buff_cache_bytes = toBytes(snap.memory.buffCacheGB);
+    d.memory_dirty_bytes = toBytes(snap.memory.dirtyGB);
+    d.memory_writeback_bytes = toBytes(snap.memory.writebackGB);
+    d.memory_slab_bytes = toBytes(snap.memory.slabGB);
+    d.memory_shmem_bytes = toBytes(snap.memory.shmemGB);
+    d.memory_anon_huge_pages_bytes = toBytes(snap.memory.anonHugePagesGB);
+    d.memory_percent = snap.memory.usagePercent;
+    d.swap_total_bytes = toBytes(snap.swap.totalGB);
+    d.swap_used_bytes = toBytes(snap.swap.usedGB);
+    d.swap_free_bytes = toBytes(snap.swap.freeGB);
+    d.swap_percent = snap.swap.usagePercent;
+    d.disk_total_bytes = toBytes(snap.disk.totalGB);
+    d.disk_used_bytes = toBytes(snap.disk.usedGB);
+    d.disk_available_bytes = toBytes(snap.disk.availableGB);
+    d.disk_percent = snap.disk.usagePercent;
+
+    copyCpu(d.cpu_total, snap.cpuTotal);
+    d.cpu_total.id = -1;
+    uint32_t cpus = (uint32_t)min(snap.cpuCores.size(), (size_t)MONITOR_SHM_MAX_CPUS);
+    for (uint32_t i = 0; i < cpus; ++i)
+        copyCpu(d.cpus[i], snap.cpuCores[i]);
+    d.cpu_count = cpus;
+
+    uint32_t sensors = 0;
+    for (const SensorReading &sensor : snap.sensors->readings)
+    {
+        if (sensors == MONITOR_SHM_MAX_SENSORS)
+            break;
+        struct monitor_shm_sensor &out = d.sensors[sensors++];
+        out.type = sensor.type == SENSOR_FAN ? MONITOR_SHM_SENSOR_FAN : MONITOR_SHM_SENSOR_TEMPERATURE;
+        out.value = sensor.value;
+        copyString(out.label, sensor.label);
+    }
+    d.sensor_count = sensors;
+
+    uint32_t interfaces = 0;
+    for (const auto &rx : snap.network->rxStats)
+    {
+        if (interfaces == MONITOR_SHM_MAX_INTERFACES)
+            break;
+        struct monitor_shm_interface &out = d.interfaces[interfaces++];
+        copyString(out.name, rx.first);
+        out.rx_bytes = rx.second.bytes;
+        out.rx_packets = rx.second.packets;
+        out.rx_errors = rx.second.errs;
+        out.rx_drop = rx.second.drop;
+        auto tx = snap.network->txStats.find(rx.first);
+        bool hasTx = tx != snap.network->txStats.end();
+        out.tx_bytes = hasTx ? tx->second.bytes : 0;
+        out.tx_packets = hasTx ? tx->second.packets : 0;
+        out.tx_errors = hasTx ? tx->second.errs : 0;
+        out.tx_drop = hasTx ? tx->second.drop : 0;
+    }
+    d.interface_count = interfaces;
+
+    // The process table is most of the segment and only changes once per
+    // scan, while the CPU values above change on every history tick
+    if (snap.processes != lastProcesses)
+    {
+        const vector<Proc> &processes = snap.processes->processes;
+        uint32_t count = (uint32_t)min(processes.size(), (size_t)MONITOR_SHM_MAX_PROCESSES);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const Proc &p = processes[i];
+            struct monitor_shm_process &out = d.processes[i];
+            out.pid = p.pid;
+            out.cpu_percent = p.cpuUsage;
+            out.rss_bytes = (uint64_t)max(p.rss, 0LL) * 1024;
+            out.vsize_bytes = (uint64_t)max(p.vsize, 0LL);
+            out.swap_bytes = (uint64_t)max(p.swap, 0LL) * 1024;
+            out.state = p.state;
+            copyString(out.name, p.name);
+        }
+        d.process_count = count;
+        lastProcesses = snap.processes;
+    }
+
+    __atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
@@ -1,5 +1,8 @@
-#include "header.h"
-#include <cctype> // For isdigit
+#include "collector.h"
+#include <sys/utsname.h> // For uname
+
+// System-wide files are kept open and reread with pread()
+static ProcFile proc_uptime("/proc/uptime");
 
 // get cpu id and information, you can use `proc/cpuinfo`
 string CPUinfo()
@@ -73,172 +76,55 @@ string getHostname()
     return "Unknown";
 }
 
-// getTotalProcesses, this will get the total number of processes
-int getTotalProcesses()
+// Gathers every host fact once; callers cache the result
+HostInfo readHostInfo()
 {
-    int count = 0;
-    DIR *dir;
-    struct dirent *ent;
-
-    // Open the /proc directory
-    if ((dir = opendir("/proc")) == NULL)
-    {
-        perror("opendir");
-        return -1;
-    }
-
-    // Iterate over all entries in /proc
-    while ((ent = readdir(dir)) != NULL)
-    {
-        // Check if the entry is a directory and its name consists only of digits (PIDs)
-        if (ent->d_type == DT_DIR)
-        {
-            bool is_pid = true;
-            for (char *p = ent->d_name; *p; ++p)
-            {
-                if (!isdigit(*p))
-                {
-                    is_pid = false;
-                    break;
-                }
-            }
-            if (is_pid)
-            {
-                count++;
-            }
-        }
-    }
-
-    closedir(dir);
-    return count;
+    HostInfo info;
+    info.osName = getOsName();
+    info.cpuType = CPUinfo();
+    info.hostname = getHostname();
+    info.loggedInUser = getLoggedInUser();
+    return info;
 }
 
-// Function to get CPU usage percentage
-float getCPUUsage()
+bool hostnameChanged(const HostInfo &info, string &hostname)
 {
-    static unsigned long long lastTotalUser = 0, lastTotalUserNice = 0, lastTotalSystem = 0, lastTotalIdle = 0;
-    unsigned long long totalUser, totalUserNice, totalSystem, totalIdle;
-    float cpu_usage = 0.0;
-
-    ifstream file("/proc/stat");
-    string line;
-    getline(file, line);
-    file.close();
-
-    sscanf(line.c_str(), "cpu %llu %llu %llu %llu", &totalUser, &totalUserNice, &totalSystem, &totalIdle);
-
-    if (totalUser < lastTotalUser || totalUserNice < lastTotalUserNice || totalSystem < lastTotalSystem || totalIdle < lastTotalIdle)
-    {
-        // Overflow detection. Just skip this value.
-        cpu_usage = 0.0;
-    }
-    else
-    {
-        unsigned long long totalUserDiff = totalUser - lastTotalUser;
-        unsigned long long totalUserNiceDiff = totalUserNice - lastTotalUserNice;
-        unsigned long long totalSystemDiff = totalSystem - lastTotalSystem;
-        unsigned long long totalIdleDiff = totalIdle - lastTotalIdle;
-        unsigned long long totalDiff = totalUserDiff + totalUserNiceDiff + totalSystemDiff + totalIdleDiff;
-
-        if (totalDiff > 0)
-        {
-            cpu_usage = (float)(totalUserDiff + totalUserNiceDiff + totalSystemDiff) / (float)totalDiff * 100.0f;
-        }
-        else
-        {
-            cpu_usage = 0.0f;
-        }
-    }
-
-    lastTotalUser = totalUser;
-    lastTotalUserNice = totalUserNice;
-    lastTotalSystem = totalSystem;
-    lastTotalIdle = totalIdle;
-
-    return cpu_usage;
-}
-
-CPUStats getCPUStats()
-{
-    CPUStats stats = {};
-    ifstream file("/proc/stat");
-    string line;
-    if (getline(file, line))
-    {
-        sscanf(line.c_str(), "cpu %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld",
-               &stats.user, &stats.nice, &stats.system, &stats.idle, &stats.iowait, &stats.irq, &stats.softirq, &stats.steal, &stats.guest, &stats.guestNice);
-    }
-    file.close();
-    return stats;
+    struct utsname name;
+    if (uname(&name) != 0 || info.hostname == name.nodename)
+        return false;
+    hostname = name.nodename;
+    return true;
 }
 
 // Function to get fan status (e.g., "active", "inactive")
 // Note: Fan status is typically found in /sys, not /proc.
-// This implementation attempts to read from a common /sys path.
+// The sensor registry enumerates /sys/class/hwmon once instead of probing paths.
 string getFanStatus()
 {
-    // Scan for all available fan inputs and return "Active" if any are found
-    for (int i = 0; i < 10; ++i) { // Check up to 10 hwmon devices
-        for (int j = 1; j < 10; ++j) { // Check up to 9 fan inputs per device
-            string path = "/sys/class/hwmon/hwmon" + to_string(i) + "/fan" + to_string(j) + "_input";
-            ifstream file(path);
-            if (file.is_open()) {
-                return "Active";
-            }
-        }
-    }
-    return "Inactive";
+    return sensorRegistry().hasFan() ? "Active" : "Inactive";
 }
 
 // Function to get fan speed (RPM)
 // Note: Fan speed is typically found in /sys, not /proc.
-// This implementation attempts to read from a common /sys path.
+// Reads the first fan found by the sensor registry (one pread).
 float getFanSpeed()
 {
-    // Scan for the first available fan speed
-    for (int i = 0; i < 10; ++i) {
-        for (int j = 1; j < 10; ++j) {
-            string path = "/sys/class/hwmon/hwmon" + to_string(i) + "/fan" + to_string(j) + "_input";
-            ifstream file(path);
-            string line;
-            if (file.is_open() && getline(file, line)) {
-                try {
-                    return stof(line);
-                } catch (const std::exception &e) {
-                    // Ignore conversion errors and continue scanning
-                }
-            }
-        }
-    }
-    return 0.0f; // Default if no fan speed is found
+    return sensorRegistry().readFanSpeed();
 }
 
 // Function to get CPU temperature (Celsius)
 // Note: CPU temperature is typically found in /sys, not /proc.
-// This implementation attempts to read from a common /sys path.
+// Reads the first thermal zone (or hwmon temperature) found by the sensor registry.
 float getCPUTemperature()
 {
-    // Scan for the first available temperature sensor
-    for (int i = 0; i < 10; ++i) { // Check up to 10 thermal zones
-        string path = "/sys/class/thermal/thermal_zone" + to_string(i) + "/temp";
-        ifstream file(path);
-        string line;
-        if (file.is_open() && getline(file, line)) {
-            try {
-                return stof(line) / 1000.0f;
-            } catch (const std::exception &e) {
-                // Ignore conversion errors and continue scanning
-            }
-        }
-    }
-    return 0.0f; // Default if no temperature is found
+    return sensorRegistry().readTemperature();
 }
+
 // Function to get system uptime in seconds
 float getSystemUptime()
 {
-    ifstream file("/proc/uptime");
-    string line;
-    getline(file, line);
-    file.close();
-    return stof(line.substr(0, line.find(" ")));
+    const char *uptime = proc_uptime.read();
+    if (!uptime)
+        return 0.0f;
+    return strtof(uptime, nullptr);
 }
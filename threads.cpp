@@ -0,0 +1,100 @@
+#include "collector.h"
+#include <algorithm> // For std::sort
+
+// Fields read from /proc/[pid]/task/[tid]/stat, in the order they land in values[]
+using ThreadStatParser = StatParser<STAT_STATE, STAT_UTIME, STAT_STIME, STAT_STARTTIME, STAT_PROCESSOR>;
+
+// Reads one thread's stat line into t. Returns false if the thread exited
+// before it could be read.
+static bool readThread(const ProcDir &task, int tid, ThreadInfo &t)
+{
+    char statLine[1024];
+    ssize_t statLength = task.readFile(tid, "stat", statLine, sizeof(statLine));
+    if (statLength <= 0)
+        return false;
+
+    // The thread name can contain spaces and parentheses, like a process name
+    const char *first_paren = strchr(statLine, '(');
+    const char *last_paren = strrchr(statLine, ')');
+    if (!first_paren || !last_paren || last_paren < first_paren || last_paren[1] != ' ')
+        return false;
+
+    long long values[ThreadStatParser::count];
+    if (!ThreadStatParser::parse(last_paren + 2, statLine + statLength, values))
+        return false;
+
+    t.tid = tid;
+    t.name.assign(first_paren + 1, last_paren - (first_paren + 1));
+    t.state = (char)values[0];
+    t.utime = values[1];
+    t.stime = values[2];
+    t.starttime = values[3];
+    t.processor = (int)values[4];
+    t.cpuUsage = 0.0f;
+    return true;
+}
+
+void ThreadSampler::sample(const vector<int> &pids, const CPUStats &cpuStats, bool refresh, ProcessThreads &out)
+{
+    out.byPid.clear();
+
+    // Collapsed processes close their task directories
+    for (auto it = tasks.begin(); it != tasks.end();)
+    {
+        if (find(pids.begin(), pids.end(), it->first) == pids.end())
+            it = tasks.erase(it);
+        else
+            ++it;
+    }
+
+    for (int pid : pids)
+    {
+        auto found = tasks.find(pid);
+        if (found != tasks.end() && !refresh)
+        {
+            out.byPid[pid] = found->second.threads;
+            continue;
+        }
+
+        Task &task = tasks[pid];
+        if (!task.dir)
+        {
+            char path[32];
+            snprintf(path, sizeof(path), "/proc/%d/task", pid);
+            task.dir.reset(new ProcDir(path));
+        }
+        // The process exited (or never existed). Its directory is dropped, so
+        // a process that later gets the same pid is opened afresh.
+        if (task.dir->fd() < 0 || !task.dir->listPids(tids) || tids.empty())
+        {
+            tasks.erase(pid);
+            continue;
+        }
+        sort(tids.begin(), tids.end());
+
+        // Both lists are in tid order: walk the last refresh alongside
+        vector<ThreadInfo> threads;
+        threads.reserve(tids.size());
+        bool hasPrevious = !task.threads.empty();
+        size_t prev = 0;
+        for (int tid : tids)
+        {
+            ThreadInfo t;
+            if (!readThread(*task.dir, tid, t))
+                continue;
+            while (prev < task.threads.size() && task.threads[prev].tid < tid)
+                prev++;
+            // A matching start time rules out a recycled tid
+            if (hasPrevious && prev < task.threads.size() && task.threads[prev].tid == tid &&
+                task.threads[prev].starttime == t.starttime)
+            {
+                const ThreadInfo &p = task.threads[prev];
+                t.cpuUsage = calculateCPUTimeUsage((t.utime + t.stime) - (p.utime + p.stime), task.cpuStats, cpuStats);
+            }
+            threads.push_back(move(t));
+        }
+        task.threads = move(threads);
+        task.cpuStats = cpuStats;
+        out.byPid[pid] = task.threads;
+    }
+}
@@ -0,0 +1,79 @@
+#include "collector.h"
+
+WorkerPool::WorkerPool(unsigned workers)
+    : task(nullptr), count(0), next(0), active(0), generation(0), stopping(false)
+{
+    for (unsigned i = 0; i < workers; ++i)
+        threads.emplace_back(&WorkerPool::workerLoop, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        lock_guard<mutex> lock(m);
+        stopping = true;
+    }
+    started.notify_all();
+    for (auto &t : threads)
+        t.join();
+}
+
+// Claims task indices until none are left
+void WorkerPool::drain()
+{
+    size_t i;
+    while ((i = next.fetch_add(1)) < count)
+        (*task)(i);
+}
+
+void WorkerPool::run(size_t taskCount, const function<void(size_t)> &fn)
+{
+    if (taskCount == 0)
+        return;
+
+    // Not worth waking anyone for a single task
+    if (threads.empty() || taskCount == 1)
+    {
+        for (size_t i = 0; i < taskCount; ++i)
+            fn(i);
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(m);
+        task = &fn;
+        count = taskCount;
+        next = 0;
+        active = threads.size();
+        generation++;
+    }
+    started.notify_all();
+
+    // The calling thread works too instead of just waiting
+    drain();
+
+    unique_lock<mutex> lock(m);
+    finished.wait(lock, [&] { return active == 0; });
+    task = nullptr;
+}
+
+void WorkerPool::workerLoop()
+{
+    unsigned long seen = 0;
+    for (;;)
+    {
+        {
+            unique_lock<mutex> lock(m);
+            started.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+
+        drain();
+
+        lock_guard<mutex> lock(m);
+        if (--active == 0)
+            finished.notify_one();
+    }
+}